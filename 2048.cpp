@@ -11,11 +11,59 @@
 #include <fstream>
 #include <iterator>
 #include <string>
+#include <stdexcept>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 #include "episode.h"
 #include "statistics.h"
+#include "pool.h"
+#include "server.h"
+#include "rollout.h"
+#include "mcts.h"
+#include "paired.h"
+
+/**
+ * the slider selected by 'search=rollout|mcts|strategic' in its arguments, the strategic slider by default
+ * return null if the arguments are invalid, e.g., the weights do not fit the features
+ */
+std::unique_ptr<agent> make_slider(const std::string& args) {
+	try {
+		std::string search = agent("search=strategic " + args).property("search");
+		if (search == "rollout") return std::unique_ptr<agent>(new rollout_slider(args));
+		if (search == "mcts") return std::unique_ptr<agent>(new mcts_slider(args));
+		if (search == "strategic") return std::unique_ptr<agent>(new strategic_slider(args));
+		throw std::invalid_argument("unknown search: " + search);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return nullptr;
+	}
+}
+
+/**
+ * play a game between the slider and the placer, recorded in the statistics
+ */
+episode& play(statistics& stats, agent& slide, agent& place, const board* start = nullptr) {
+	slide.open_episode("~:" + place.name());
+	place.open_episode(slide.name() + ":~");
+
+	stats.open_episode(slide.name() + ":" + place.name());
+	episode& game = stats.back();
+	if (start) game.start_from(*start);
+	while (true) {
+		agent& who = game.take_turns(slide, place);
+		action move = who.take_action(game.state());
+//		std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
+		if (game.apply_action(move) != true) break;
+		if (who.check_for_win(game.state())) break;
+	}
+	agent& win = game.last_turns(slide, place);
+	stats.close_episode(win.name());
+
+	slide.close_episode(win.name());
+	place.close_episode(win.name());
+	return game;
+}
 
 int main(int argc, const char* argv[]) {
 	std::cout << "2048 Demo: ";
@@ -23,8 +71,12 @@ int main(int argc, const char* argv[]) {
 	std::cout << std::endl << std::endl;
 
 	size_t total = 1000, block = 0, limit = 0;
-	std::string slide_args, place_args;
+	std::string slide_args, place_args, compare_args, stop_args;
+	bool stop = false;
 	std::string load_path, save_path;
+	std::string pool_args;
+	std::string serve_args;
+	bool serve = false;
 	for (int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		auto match_arg = [&](std::string flag) -> bool {
@@ -43,15 +95,30 @@ int main(int argc, const char* argv[]) {
 			limit = std::stoull(next_opt());
 		} else if (match_arg("slide") || match_arg("play")) {
 			slide_args = next_opt();
+		} else if (match_arg("stop")) {
+			stop_args = next_opt();
+			stop = true;
+		} else if (match_arg("compare")) {
+			compare_args = next_opt();
 		} else if (match_arg("place") || match_arg("env")) {
 			place_args = next_opt();
 		} else if (match_arg("load")) {
 			load_path = next_opt();
 		} else if (match_arg("save")) {
 			save_path = next_opt();
+		} else if (match_arg("pool")) {
+			pool_args = next_opt();
+		} else if (match_arg("serve")) {
+			serve_args = next_opt();
+			serve = true;
 		}
 	}
 
+	if (serve) {
+		move_server server(serve_args);
+		return server.serve();
+	}
+
 	statistics stats(total, block, limit);
 
 	if (load_path.size()) {
@@ -61,28 +128,41 @@ int main(int argc, const char* argv[]) {
 		if (stats.is_finished()) stats.summary();
 	}
 
-	strategic_slider slide(slide_args);
-	random_placer place(place_args);
-
-	while (!stats.is_finished()) {
-//		std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
-		slide.open_episode("~:" + place.name());
-		place.open_episode(slide.name() + ":~");
+	std::unique_ptr<agent> slider = make_slider(slide_args);
+	if (!slider) return -1;
+	agent& slide = *slider;
+	start_pool pool(pool_args);
 
-		stats.open_episode(slide.name() + ":" + place.name());
-		episode& game = stats.back();
-		while (true) {
-			agent& who = game.take_turns(slide, place);
-			action move = who.take_action(game.state());
-//			std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
-			if (game.apply_action(move) != true) break;
-			if (who.check_for_win(game.state())) break;
+	if (compare_args.size()) {
+		// 配对评估：两个玩家各自对局，第g局的放置取自相同的随机流
+		std::unique_ptr<agent> other = make_slider(compare_args);
+		if (!other) return -1;
+		random_placer place(place_args + " keyed=1"), twin(place_args + " keyed=1");
+		statistics rival(total, block, limit);
+		paired report(block);
+		if (stop) report.stop_when(stop_args);
+		while (!stats.is_finished() && !report.settled()) {
+			board start;
+			bool drawn = pool.draw(start);
+			episode& a = play(stats, slide, place, drawn ? &start : nullptr);
+			episode& b = play(rival, *other, twin, drawn ? &start : nullptr);
+			report.add(a.score(), b.score(), a.state().is_win(), b.state().is_win());
+			pool.collect(a);
 		}
-		agent& win = game.last_turns(slide, place);
-		stats.close_episode(win.name());
-
-		slide.close_episode(win.name());
-		place.close_episode(win.name());
+		std::cout << "A: " << slide_args << std::endl;
+		stats.summary();
+		std::cout << "B: " << compare_args << std::endl;
+		rival.summary();
+		report.summary();
+	} else {
+		random_placer place(place_args);
+		if (stop) stats.stop_when(stop_args);
+		while (!stats.is_finished()) {
+			board start;
+			bool drawn = pool.draw(start);
+			pool.collect(play(stats, slide, place, drawn ? &start : nullptr));
+		}
+		if (stop) stats.summary();
 	}
 
 	if (save_path.size()) {
@@ -19,20 +19,26 @@
 #include <vector>
 #include <cmath>
 #include <deque>
+#include <numeric>
+#include <array>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "options.h"
 #include "board.h"
 #include "action.h"
 #include "weight.h"
+#include "ntuple.h"
+#include "strategy.h"
+#include "learner.h"
+#include "checkpoint.h"
+#include "evaluator.h"
 
 class agent {
 public:
-	agent(const std::string& args = "") {
-		std::stringstream ss("name=unknown role=unknown " + args);
-		for (std::string pair; ss >> pair; ) {
-			std::string key = pair.substr(0, pair.find('='));
-			std::string value = pair.substr(pair.find('=') + 1);
-			meta[key] = { value };
-		}
-	}
+	agent(const std::string& args = "") : meta("name=unknown role=unknown " + args) {}
 	virtual ~agent() {}
 	virtual void open_episode(const std::string& flag = "") {}
 	virtual void close_episode(const std::string& flag = "") {}
@@ -41,19 +47,12 @@ public:
 
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
-	virtual void notify(const std::string& msg) { meta[msg.substr(0, msg.find('='))] = { msg.substr(msg.find('=') + 1) }; }
+	virtual void notify(const std::string& msg) { meta.set(msg); }
 	virtual std::string name() const { return property("name"); }
 	virtual std::string role() const { return property("role"); }
 
 protected:
-	typedef std::string key;
-	struct value {
-		std::string value;
-		operator std::string() const { return value; }
-		template<typename numeric, typename = typename std::enable_if<std::is_arithmetic<numeric>::value, numeric>::type>
-		operator numeric() const { return numeric(std::stod(value)); }
-	};
-	std::map<key, value> meta;
+	options meta;
 };
 
 /**
@@ -76,74 +75,241 @@ protected:
  */
 class weight_agent : public agent {
 public:
-	weight_agent(const std::string& args = "") : agent(args), alpha(0) {
+	weight_agent(const std::string& args = "") : agent(args), alpha(0), paged_bytes(0), io_threads(0), direct_io(false) {
+		if (meta.find("sparse") != meta.end()) // paged tables, the budget per table in MB
+			paged_bytes = size_t(double(meta["sparse"]) * (1 << 20));
+		if (meta.find("io") != meta.end()) // save as a checkpoint with parallel I/O threads
+			io_threads = std::max(int(meta["io"]), 1);
+		if (meta.find("direct") != meta.end())
+			direct_io = int(meta["direct"]);
 		if (meta.find("init") != meta.end())
 			init_weights(meta["init"]);
 		if (meta.find("load") != meta.end())
 			load_weights(meta["load"]);
 		if (meta.find("alpha") != meta.end())
 			alpha = float(meta["alpha"]);
+		if (meta.find("watch") != meta.end() && meta.find("load") != meta.end()) // polling interval in ms
+			watch.reset(new watcher{ meta["load"], int(meta["watch"]) });
 	}
+	/**
+	 * the program exits if saving fails, since there is no one else to tell at this point
+	 * (the shared library saves by itself before, see lib2048.cpp)
+	 */
 	virtual ~weight_agent() {
 		if (meta.find("save") != meta.end())
-			save_weights(meta["save"]);
+			if (!save_weights(meta["save"])) std::exit(-1);
+		if (meta.find("export") != meta.end()) // only the non-zero runs, for distribution
+			if (!checkpoint::export_runs(meta["export"], net)) std::exit(-1);
+	}
+
+	/**
+	 * hot reload: between games, reload the watched weight file once it has been rewritten,
+	 * so that the games in flight finish on the old weights
+	 */
+	virtual void open_episode(const std::string& flag = "") {
+		if (watch && watch->changed()) reload_weights(watch->path);
 	}
 
 protected:
+	/**
+	 * poll the signature (inode, size, modification time) of a file at most every 'interval' ms
+	 * a change is reported once the new signature stays the same for one more poll,
+	 * i.e., the writer is done, whether it renamed a new file over the path or rewrote it in place
+	 */
+	struct watcher {
+		std::string path;
+		int interval;
+		std::chrono::steady_clock::time_point last;
+		std::array<int64_t, 4> seen, pending;
+
+		watcher(const std::string& path, int interval) : path(path), interval(interval),
+			last(std::chrono::steady_clock::now()), seen(signature()), pending(seen) {}
+
+		std::array<int64_t, 4> signature() const {
+			struct stat st;
+			if (::stat(path.c_str(), &st) != 0) return {};
+			return { int64_t(st.st_ino), int64_t(st.st_size), int64_t(st.st_mtim.tv_sec), int64_t(st.st_mtim.tv_nsec) };
+		}
+		bool changed() {
+			auto now = std::chrono::steady_clock::now();
+			if (now - last < std::chrono::milliseconds(interval)) return false;
+			last = now;
+			std::array<int64_t, 4> sig = signature();
+			bool settled = (sig == pending && sig != seen && sig[1] != 0);
+			pending = sig;
+			if (settled) seen = sig;
+			return settled;
+		}
+	};
+
+	/**
+	 * reload the weights, replacing only the tables that changed if the layout is the same
+	 * a checkpoint of the same layout is compared through a mapping without being loaded
+	 * otherwise the file is loaded aside, and the current weights are kept if it cannot be loaded or does not fit
+	 * return the number of tables replaced, or -1 if the current weights are kept
+	 */
+	virtual int reload_weights(const std::string& path) {
+		int replaced = checkpoint::refresh(path, net);
+		size_t total = net.size();
+		if (replaced < 0) {
+			std::vector<weight> next;
+			std::string error = read_weights(path, next) ? misfit(next) : "cannot load the file";
+			if (error.size()) {
+				std::cout << "[重载] " << path << ": " << error << ", 保留原权重" << std::endl;
+				return -1;
+			}
+			if (!checkpoint::cap_of(next)) checkpoint::set_cap(next, checkpoint::cap_of(net));
+			replaced = 0;
+			for (size_t i = 0; i < next.size(); i++) { // keep the unchanged tables, which are warm in cache
+				const weight& a = i < net.size() ? net[i] : next[i];
+				const weight& b = next[i];
+				bool same = i < net.size() && a.size() == b.size() && a.remapping() == b.remapping();
+				for (size_t k = 0; same && k < b.size(); k++) same = (a[k] == b[k]);
+				if (same) next[i] = std::move(net[i]);
+				else replaced++;
+			}
+			std::swap(net, next);
+			total = net.size();
+		}
+		std::cout << "[重载] " << path << ": " << replaced << "/" << total << "个权重表已更新" << std::endl;
+		return replaced;
+	}
+
+	/**
+	 * why the tables do not fit the agent, or an empty string if they do
+	 */
+	virtual std::string misfit(const std::vector<weight>& tables) const { return ""; }
+
+	/**
+	 * why the tables do not fit the features: a recorded cap other than the cap of the features,
+	 * or a table whose size is not cap^n for its n-tuple; an empty string if they fit
+	 */
+	static std::string table_misfit(const ntuple& features, const std::vector<weight>& tables) {
+		unsigned cap = features.cap(), recorded = checkpoint::cap_of(tables);
+		if (recorded && recorded != cap)
+			return "cap=" + std::to_string(cap) + " does not match the cap " + std::to_string(recorded) + " of the weights";
+		for (size_t i = 0; i < std::min(tables.size(), features.tuples()); i++) {
+			if (tables[i].size() != features.span(i))
+				return "table " + std::to_string(i) + " has " + std::to_string(tables[i].size()) + " entries, but "
+					+ std::to_string(features.span(i)) + " are needed by a " + std::to_string(features.length(i)) + "-tuple with cap=" + std::to_string(cap);
+		}
+		return "";
+	}
+
+	/**
+	 * the features of the arguments 'tuple=' and 'cap=', where the cap defaults to the one recorded with
+	 * the weights, or 16 if none is recorded; throw if the weights do not fit, otherwise record the cap
+	 */
+	ntuple adopt_features() {
+		unsigned recorded = checkpoint::cap_of(net);
+		unsigned cap = recorded ? recorded : 16;
+		if (meta.find("cap") != meta.end())
+			cap = std::min(std::max(unsigned(meta["cap"]), 2u), 64u);
+		std::vector<ntuple::pattern> patterns = ntuple::default_patterns();
+		if (meta.find("tuple") != meta.end()) patterns = ntuple::parse_patterns(meta["tuple"]);
+		ntuple features(patterns, cap);
+		std::string error = table_misfit(features, net);
+		if (error.size()) throw std::runtime_error(error);
+		checkpoint::set_cap(net, cap);
+		return features;
+	}
+
 	virtual void init_weights(const std::string& info) {
 		std::string res = info; // comma-separated sizes, e.g., "65536,65536"
 		for (char& ch : res)
 			if (!std::isdigit(ch)) ch = ' ';
 		std::stringstream in(res);
-		for (size_t size; in >> size; net.emplace_back(size));
+		for (size_t size; in >> size; ) {
+			if (paged_bytes) net.push_back(weight::paged(size, paged_bytes));
+			else net.emplace_back(size);
+		}
 	}
 	virtual void load_weights(const std::string& path) {
-		std::ifstream in(path, std::ios::in | std::ios::binary);
-		if (!in.is_open()) std::exit(-1);
-		uint32_t size;
-		in.read(reinterpret_cast<char*>(&size), sizeof(size));
-		net.resize(size);
-		for (weight& w : net) in >> w;
-		in.close();
-	}
-	virtual void save_weights(const std::string& path) {
-		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
-		if (!out.is_open()) std::exit(-1);
-		uint32_t size = net.size();
-		out.write(reinterpret_cast<char*>(&size), sizeof(size));
-		for (weight& w : net) out << w;
-		out.close();
+		if (!read_weights(path, net)) throw std::runtime_error("cannot load " + path);
+	}
+	bool read_weights(const std::string& path, std::vector<weight>& tables) const {
+		unsigned threads = io_threads ? io_threads : std::max(std::thread::hardware_concurrency(), 1u);
+		return checkpoint::load_any(path, tables, threads, direct_io, paged_bytes);
+	}
+	virtual bool save_weights(const std::string& path) {
+		return write_weights(path, net, io_threads);
+	}
+	bool write_weights(const std::string& path, const std::vector<weight>& tables, unsigned threads) const {
+		return threads ? checkpoint::save(path, tables, threads, direct_io) : checkpoint::save_stream(path, tables);
 	}
 
 protected:
 	std::vector<weight> net;
 	float alpha;
+	size_t paged_bytes;
+	unsigned io_threads;
+	bool direct_io;
+	std::unique_ptr<watcher> watch;
 };
 
 /**
  * default random environment
  * add a new random tile to an empty cell
+ * the tile follows the spawn distribution of the rules, by default
  * 2-tile: 90%
  * 4-tile: 10%
+ *
+ * with 'keyed=1', placement i of game g draws from its own engine seeded by (seed, g, i),
+ * so that placers with the same seed give the same random stream to different sliders,
+ * i.e., common random numbers for paired evaluation
  */
 class random_placer : public random_agent {
 public:
+	typedef board::rules::spawn spawn;
+
 	random_placer(const std::string& args = "") : random_agent("name=place role=placer " + args),
-		space({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }), popup(0, 9) {}
+		popup(0, spawn::total - 1), keyed(false), seed(0), games(0), placed(0) {
+		std::iota(space.begin(), space.end(), 0);
+		if (meta.find("keyed") != meta.end())
+			keyed = int(meta["keyed"]);
+		if (meta.find("seed") != meta.end())
+			seed = unsigned(int(meta["seed"]));
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		games++;
+		placed = 0;
+	}
 
 	virtual action take_action(const board& after) {
+		if (keyed) {
+			std::iota(space.begin(), space.end(), 0);
+			engine.seed(key(seed, games, placed++));
+		}
 		std::shuffle(space.begin(), space.end(), engine);
 		for (int pos : space) {
 			if (after(pos) != 0) continue;
-			board::cell tile = popup(engine) ? 1 : 2;
+			board::cell tile = spawn::tile(popup(engine));
 			return action::place(pos, tile);
 		}
 		return action();
 	}
 
 private:
-	std::array<int, 16> space;
+	/**
+	 * the seed of a placement, mixed by splitmix64 into the range of the engine
+	 */
+	static unsigned key(uint64_t seed, uint64_t game, uint64_t index) {
+		uint64_t z = (seed << 40) ^ (game << 20) ^ index;
+		z += 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		z ^= z >> 31;
+		return unsigned(z % 2147483646) + 1;
+	}
+
+private:
+	std::array<int, board::cells> space;
 	std::uniform_int_distribution<int> popup;
+	bool keyed;
+	uint64_t seed;
+	uint64_t games;
+	uint64_t placed;
 };
 
 /**
@@ -177,8 +343,8 @@ private:
 	int game_count = 0;
 	int move_count = 0;
 	std::string last_game_record;
-	float danger_penalty_factor = 0.7f;  // 危险惩罚系数
-	float survival_bonus = 1000.0f;      // 存活奖励
+	bool record_games = true;            // 是否把对局记录写入win_games.log/normal_games.log
+	strategy adjustment;                 // 危险惩罚系数 (penalty=0.7) 与每个空格的存活奖励 (bonus=1000)
 	std::array<int, 4> opcode;           // 动作顺序
 	
 	// TD学习相关参数
@@ -197,25 +363,175 @@ private:
 	};
 	std::vector<GameStep> current_episode; // 当前游戏的轨迹
 	
+	// N-tuple特征（模式及其同构变换）
+	ntuple features;
+	
+	// 异步学习：对局线程只负责下棋，轨迹以特征索引形式交给独立的学习线程
+	std::unique_ptr<td_learner> learner;
+	std::unique_ptr<trajectory> path;
+	rcu<std::vector<weight>>::pointer pinned; // 对局线程固定使用的快照（不复制），主权重在学习线程中
+	
+	// 批量更新：每batch局累积的权重更新按地址排序合并后一次性写入（0表示逐步精确更新）
+	size_t batch_games = 0;
+	weight_batch batch;
+	
+	// 索引重映射的访问次数统计（remap=profile时使用）
+	size_t profile_games = 0;
+	size_t hot_entries = 4096;           // 每表移到表头的权重数
+	std::vector<std::vector<uint32_t>> visits;
+	
+	// 后台评估：每period局发布一次权重快照，由评估线程以贪婪策略对局
+	size_t eval_period = 0;
+	rcu<std::vector<weight>> eval_snapshots;
+	std::unique_ptr<evaluator> eval;
+	
+	// 选择性加深：安全时一步贪婪，危险度升高、空格减少或最佳走法接近时改用期望最大搜索
+	unsigned deep_depth = 0;             // 加深时搜索的滑动层数（0表示不加深）
+	float deep_danger = 0.4f;            // 危险度门槛
+	int deep_empty = 3;                  // 空格门槛
+	float deep_margin = 0.0005f;         // 最佳两个走法的相对差距门槛
+	struct effort {
+		size_t moves = 0;                // 决策数
+		size_t deepened = 0;             // 其中加深搜索的决策数
+		size_t nodes = 0;                // 搜索评估的盘面数
+		double time = 0;                 // 决策耗时（秒）
+	};
+	std::array<effort, 4> efforts;       // 按危险度分档：0, 0.4, 0.7, 1.0
+	
+	// 迭代加深：每步在时限内逐层加深，采用最后完成的层数及未完成一层中已搜索完的走法；置换表跨迭代与跨步保留
+	double deep_budget = 0;              // 每步的搜索时限（秒），0表示固定层数
+	struct transposition {
+		uint64_t nibble = 0;
+		uint16_t high = 0;
+		uint8_t depth = 0;               // 剩余层数，0表示空项
+		uint32_t stamp = 0;
+		float value = 0;
+	};
+	std::vector<transposition> table;    // 后状态与剩余层数对应的期望值
+	uint32_t table_stamp = 1;            // 权重更新后使旧项失效
+	std::chrono::steady_clock::time_point deadline;
+	bool expired = false;
+	size_t ticks = 0;
+	std::array<size_t, 16> completed = {}; // 各完成层数的决策数
+	
+	// 叶节点的增量估值：每个滑动方向一份缓存，同一后状态的各个放置之后同向滑动只差放置所在的行或列
+	std::array<ntuple::state, 4> leaves;
+	uint32_t leaf_stamp = 0;             // 缓存对应的table_stamp
+	
 public:
 	strategic_slider(const std::string& args = "") : weight_agent("name=strategic role=slider " + args),
 		opcode({ 0, 1, 2, 3 }) {
 		// 解析特殊参数
 		if (meta.find("penalty") != meta.end())
-			danger_penalty_factor = float(meta["penalty"]);
+			adjustment.penalty = float(meta["penalty"]);
 		if (meta.find("bonus") != meta.end())
-			survival_bonus = float(meta["bonus"]);
+			adjustment.bonus = float(meta["bonus"]);
 		if (meta.find("lambda") != meta.end())
 			lambda = float(meta["lambda"]);
 		if (meta.find("decay") != meta.end())
 			eligibility_decay = float(meta["decay"]);
+		if (meta.find("record") != meta.end())
+			record_games = int(meta["record"]);
 		if (meta.find("learning") != meta.end()) {
 			std::string learning_str = meta["learning"];
 			enable_learning = (learning_str == "1" || learning_str == "true");
 		}
+		// 瓦片上限：索引以cap为基数，大于等于cap-1的瓦片共用同一个桶
+		// 默认16（32768及以上合并），设为32可区分到2^31；cap随权重保存，载入的权重沿用其cap
+		// 元组：以十六进制格子编号表示，逗号分隔，例如 tuple=0123456,456789a（大元组建议配合sparse）
+		features = adopt_features();
 		
 		// 初始化资格迹
 		initialize_eligibility_traces();
+		
+		if (meta.find("batch") != meta.end())
+			batch_games = size_t(meta["batch"]);
+		
+		// 索引重映射：把最常访问的hot个（默认4096）权重移到表头连续存放，其余位置不变，重映射随权重文件保存
+		// remap=rank 按元组内最大瓦片排序，低瓦片组合集中在表头
+		// remap=profile 统计前profile局（默认100）的访问次数，按访问频率排序
+		if (meta.find("remap") != meta.end()) {
+			std::string mode = meta["remap"];
+			if (meta.find("hot") != meta.end()) hot_entries = size_t(meta["hot"]);
+			if (mode == "rank") {
+				remap_by_tile_rank();
+			} else if (mode == "profile") {
+				profile_games = meta.find("profile") != meta.end() ? size_t(meta["profile"]) : 100;
+				for (const weight& w : net) visits.emplace_back(w.size() < (size_t(1) << 32) && !w.is_paged() ? w.size() : 0);
+			}
+		}
+		
+		// 异步学习模式：async=1 stale=最多积压的轨迹数 sync=每学习多少局发布一次权重快照
+		// 每次发布都复制全部的表，因此sync默认为批量大小（未批量时为16局），以分摊大网络的复制成本
+		// 热重载只替换对局线程的权重，而异步学习时主权重在学习线程中，对局线程使用其快照，因此两者不能同时使用
+		if (meta.find("async") != meta.end() && int(meta["async"]) && enable_learning && !net.empty()) {
+			if (watch) throw std::invalid_argument("watch= cannot be combined with async=1, whose weights are held by the learner");
+			size_t stale = meta.find("stale") != meta.end() ? size_t(meta["stale"]) : 4;
+			size_t sync = meta.find("sync") != meta.end() ? size_t(meta["sync"]) : (batch_games ? batch_games : 16);
+			bool compact = true; // 轨迹中的索引以32位存储
+			for (const weight& w : net) compact &= (w.size() <= (size_t(1) << 32));
+			if (compact) learner.reset(new td_learner(net, update_rule(), alpha, lambda, stale, sync, batch_games));
+			if (learner) {
+				visits.clear(); // 主权重在学习线程中，不支持运行中重映射
+				learner->fetch(pinned);
+				std::vector<weight>().swap(net); // 对局线程不再保留自己的副本
+			}
+		}
+		
+		// 后台评估：eval=每个快照的评估局数 share=评估线程的CPU占比 period=每多少局评估一次 interleave=交错进行的局数
+		if (meta.find("eval") != meta.end() && size_t(meta["eval"]) && !weights().empty()) {
+			double share = meta.find("share") != meta.end() ? double(meta["share"]) : 0.25;
+			eval_period = meta.find("period") != meta.end() ? std::max<size_t>(size_t(meta["period"]), 1) : 1000;
+			unsigned seed = meta.find("seed") != meta.end() ? unsigned(meta["seed"]) : 0;
+			size_t width = meta.find("interleave") != meta.end() ? std::max<size_t>(size_t(meta["interleave"]), 1) : 1;
+			eval.reset(new evaluator(features, adjustment, eval_snapshots, size_t(meta["eval"]), share, eval_period, seed, width));
+		}
+		
+		// 选择性加深：deep=搜索层数 trigger=危险度门槛 empty=空格门槛 margin=最佳两个走法的相对差距门槛
+		// 危险度达到0.7且空格不多时再加深一层
+		if (meta.find("deep") != meta.end())
+			deep_depth = unsigned(meta["deep"]);
+		if (meta.find("trigger") != meta.end())
+			deep_danger = float(meta["trigger"]);
+		if (meta.find("empty") != meta.end())
+			deep_empty = int(meta["empty"]);
+		if (meta.find("margin") != meta.end())
+			deep_margin = float(meta["margin"]);
+		
+		// 迭代加深：budget=每步时限（如1s、2ms、500us，需带单位），deep为层数上限（默认8），tt=置换表项数
+		// 危险时会再加深一层，故层数上限比completed的范围少一层
+		if (meta.find("budget") != meta.end()) {
+			std::string budget = meta["budget"];
+			size_t unit = budget.find_first_not_of("0123456789.");
+			std::string suffix = unit != std::string::npos ? budget.substr(unit) : "";
+			double scale = suffix == "s" ? 1 : suffix == "ms" ? 1e-3 : suffix == "us" ? 1e-6 : 0;
+			if (!scale || !unit)
+				throw std::invalid_argument("budget=" + budget + " needs a time with a unit of s, ms, or us");
+			deep_budget = std::stod(budget.substr(0, unit)) * scale;
+			if (meta.find("deep") == meta.end()) deep_depth = 8;
+			deep_depth = std::min<unsigned>(deep_depth, completed.size() - 2);
+		}
+		if (deep_depth > 1 && (deep_budget > 0 || meta.find("tt") != meta.end())) {
+			size_t entries = meta.find("tt") != meta.end() ? size_t(meta["tt"]) : (size_t(1) << 18);
+			size_t size = 1;
+			while (size < entries) size <<= 1;
+			table.resize(size);
+		}
+	}
+	
+	virtual ~strategic_slider() {
+		metrics::global().erase("加深");
+		// 等待学习线程处理完所有轨迹，保存的是学习线程的主权重
+		if (learner) {
+			pinned.reset();
+			net = std::move(learner->stop());
+		}
+		batch.apply(net);
+		// 等待评估线程完成已发布的快照
+		if (eval) {
+			eval->stop();
+			std::cout << eval->report() << std::endl;
+		}
 	}
 
 	virtual void open_episode(const std::string& flag = "") override {
@@ -227,6 +543,13 @@ public:
 		// 重置游戏轨迹和资格迹
 		current_episode.clear();
 		reset_eligibility_traces();
+		for (ntuple::state& leaf : leaves) leaf.reset(); // 权重可能已重载或换用新快照
+		
+		// 异步学习：换用学习线程最新发布的权重快照
+		if (learner) {
+			learner->fetch(pinned);
+			path.reset(new trajectory(std::min(features.tuples(), weights().size()) * ntuple::isomorphisms));
+		}
 	}
 
 	virtual action take_action(const board& before) override {
@@ -267,11 +590,20 @@ public:
 			last_game_record += oss.str() + "\n";
 		}
 		
+		// 统计访问次数，用于重映射
+		if (visits.size()) {
+			for (size_t f = 0; f < std::min(features.tuples(), weights().size()) * ntuple::isomorphisms; f++) {
+				size_t index = features.index(before, f);
+				auto& count = visits[f / ntuple::isomorphisms];
+				if (index < count.size()) count[index]++;
+			}
+		}
+		
 		// 智能决策：评估所有可能的动作
 		action selected_action = select_best_action(before);
 		
-		// 如果不是第一步，对上一步进行TD学习更新
-		if (enable_learning && !current_episode.empty()) {
+		// 如果不是第一步，对上一步进行TD学习更新（异步模式由学习线程完成）
+		if (enable_learning && !learner && !current_episode.empty()) {
 			perform_td_update(before);
 		}
 		
@@ -279,7 +611,7 @@ public:
 	}
 
 	virtual bool check_for_win(const board& b) override {
-		bool has_win = b.has_two_8192();
+		bool has_win = b.is_win();
 		if (has_win) {
 			last_game_record += "【胜利条件达成】发现两个8192瓦片！\n";
 			save_game_record(true);
@@ -288,11 +620,37 @@ public:
 	}
 	
 	virtual void close_episode(const std::string& flag = "") override {
+		if (deep_depth > 1) post_effort();
+		
 		// 执行最终的TD学习更新
-		if (enable_learning && !current_episode.empty()) {
+		if (enable_learning && !learner && !current_episode.empty()) {
 			perform_final_td_update(flag);
 		}
 		
+		// 异步学习：将整局轨迹交给学习线程
+		if (learner && path && path->size()) {
+			path->final_reward = calculate_final_reward(flag);
+			learner->push(path.release());
+		}
+		
+		// 批量更新：累积满batch局后统一写入权重
+		if (batch_games && game_count % batch_games == 0) {
+			batch.apply(net);
+		}
+		
+		// 访问统计结束后按访问频率重映射
+		if (visits.size() && size_t(game_count) >= profile_games) {
+			remap_by_visits();
+		}
+		
+		// 发布权重快照供后台评估（异步学习时为对局线程取得的最新快照）
+		if (eval && game_count % eval_period == 0) {
+			batch.apply(net);
+			size_t bytes = 0;
+			for (const weight& w : weights()) bytes += w.copy_bytes();
+			eval_snapshots.publish(weights(), bytes);
+		}
+		
 		// 显示游戏摘要信息（降低频率）
 		if (enable_learning && game_count % 200 == 0) {
 			show_learning_summary(flag);
@@ -319,23 +677,51 @@ private:
 	 * 选择最佳动作：结合权重网络评估和避免胜利策略
 	 */
 	action select_best_action(const board& before) {
+		auto begin = std::chrono::steady_clock::now();
 		action best_action;
 		float best_value = -std::numeric_limits<float>::max();
 		
-		// 评估所有可能的动作
+		// 评估所有可能的动作（在同一个盘面上原地执行并撤销，避免复制）
+		std::array<float, 4> values;
+		values.fill(-std::numeric_limits<float>::max());
+		board after = before;
+		board::undo undo;
 		for (int op : opcode) {
-			board after = before;
-			board::reward reward = after.slide(op);
+			board::reward reward = after.make_slide(op, undo);
 			if (reward == -1) continue; // 无效动作
 			
 			// 计算这个动作的评估值
-			float value = evaluate_action(before, after, reward);
-			
-			if (value > best_value) {
-				best_value = value;
+			values[op] = evaluate_action(before, after, reward);
+			after.unmake(undo);
+		}
+		
+		// 需要时以期望最大搜索重新评估
+		float danger = before.calculate_danger_level();
+		effort& spent = efforts[danger >= 1.0f ? 3 : danger >= 0.7f ? 2 : danger >= 0.4f ? 1 : 0];
+		unsigned depth = deepening(before, values);
+		if (depth > 1) {
+			if (enable_learning && alpha > 0) table_stamp++; // 权重已更新
+			if (deep_budget > 0) {
+				completed[iterate(before, values, depth, begin, spent.nodes)]++;
+			} else {
+				for (int op : opcode) {
+					if (values[op] == -std::numeric_limits<float>::max()) continue;
+					board::reward reward = after.make_slide(op, undo);
+					values[op] = reward + expectimax(after, depth - 1, spent.nodes);
+					after.unmake(undo);
+				}
+			}
+			spent.deepened++;
+		}
+		
+		for (int op : opcode) {
+			if (values[op] > best_value) {
+				best_value = values[op];
 				best_action = action::slide(op);
 			}
 		}
+		spent.moves++;
+		spent.time += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
 		
 		// 如果没有找到有效动作，使用随机策略作为后备
 		if (best_value == -std::numeric_limits<float>::max()) {
@@ -362,166 +748,200 @@ private:
 			step.evaluation = evaluate_board(before);
 			
 			current_episode.push_back(step);
+			
+			if (learner) {
+				for (size_t f = 0; f < path->width; f++) path->index.push_back(features.index(before, f));
+				path->reward.push_back(step.reward);
+				path->evaluation.push_back(step.evaluation);
+			}
 		}
 		
 		return best_action;
 	}
 	
 	/**
-	 * 评估一个动作的价值：基础价值 + 策略调整
+	 * 决定搜索的滑动层数：1表示维持一步贪婪
+	 * 危险度达到门槛、空格不多于门槛、或最佳两个走法的差距在相对门槛内时加深
 	 */
-	float evaluate_action(const board& before, const board& after, board::reward reward) {
-		// 基础评估：合并奖励 + 权重网络评估（如果有的话）
-		float base_value = static_cast<float>(reward);
-		
-		// 如果网络已初始化，使用网络评估
-		if (!net.empty()) {
-			base_value += evaluate_board(after);
-		}
-		
-		// 策略调整：考虑危险度
-		float danger_after = after.calculate_danger_level();
-		float strategy_penalty = danger_after * danger_penalty_factor * 10000.0f;
-		
-		// 存活奖励：更多空格 = 更好
-		int empty_cells = 0;
-		for (int i = 0; i < 16; i++) {
-			if (after(i) == 0) empty_cells++;
+	unsigned deepening(const board& before, const std::array<float, 4>& values) const {
+		if (deep_depth < 2) return 1;
+		float first = -std::numeric_limits<float>::max(), second = first;
+		for (float v : values) {
+			if (v > first) second = first, first = v;
+			else if (v > second) second = v;
 		}
-		float survival_reward = empty_cells * survival_bonus;
-		
-		// 最终评估值
-		float final_value = base_value - strategy_penalty + survival_reward;
-		
-		return final_value;
+		if (second == -std::numeric_limits<float>::max()) return 1; // 只有一个合法走法
+		float danger = before.calculate_danger_level();
+		int empty = before.count_tile_value(0);
+		bool close = (first - second) <= deep_margin * std::abs(first);
+		if (danger < deep_danger && empty > deep_empty && !close) return 1;
+		return deep_depth + (danger >= 0.7f && empty <= 6 ? 1 : 0);
 	}
 	
 	/**
-	 * 使用完整的N-tuple网络评估棋盘状态
-	 * 实现多个重叠的瓦片模式进行特征提取
+	 * 期望最大搜索：对后状态的所有放置取期望，每个放置之后取最佳滑动
+	 * depth为剩余的滑动层数，叶节点以evaluate_action的后状态部分估值（最后一层以leaf增量估值），无路可走的盘面价值为0
+	 * 达成胜利条件的后状态即为终局，价值为胜利的最终奖励（见calculate_final_reward）
 	 */
-	float evaluate_board(const board& b) {
-		if (net.empty()) return 0.0f;
-		
-		float value = 0.0f;
-		
-		// 定义常用的N-tuple模式（4-tuple设计）
-		// 使用4x4-tuple模式，每个模式覆盖4个相邻位置
-		static const std::vector<std::vector<int>> patterns = {
-			{0, 1, 4, 5},   // 左上角2x2
-			{2, 3, 6, 7},   // 右上角2x2  
-			{8, 9, 12, 13}, // 左下角2x2
-			{10, 11, 14, 15} // 右下角2x2
-		};
-		
-		// 对每个模式和其同构变换进行评估
-		for (size_t i = 0; i < std::min(patterns.size(), net.size()); i++) {
-			if (net[i].size() == 0) continue;
-			
-			// 评估原始模式
-			value += evaluate_pattern(b, patterns[i], net[i]);
-			
-			// 评估同构变换（镜像、旋转等）
-			value += evaluate_isomorphic_patterns(b, patterns[i], net[i]);
+	float expectimax(const board& after, unsigned depth, size_t& nodes) {
+		if (timeout()) return 0; // 超时，本次迭代作废
+		nodes++;
+		if (after.is_win()) return calculate_final_reward("win");
+		if (depth == 0) return evaluate_action(after, after, 0);
+		transposition* entry = nullptr;
+		board::packed key = after.pack();
+		if (table.size()) {
+			uint64_t h = (key.nibble ^ (uint64_t(key.high) << 47) ^ depth) * 0x9e3779b97f4a7c15ull;
+			entry = &table[(h ^ (h >> 29)) & (table.size() - 1)];
+			if (entry->depth == depth && entry->stamp == table_stamp && entry->nibble == key.nibble && entry->high == key.high)
+				return entry->value;
+		}
+		typedef board::rules::spawn spawn;
+		static const float four = [] { // 出现4的概率
+			unsigned count = 0;
+			for (unsigned d = 0; d < spawn::total; d++) count += (spawn::tile(d) == 2);
+			return float(count) / spawn::total;
+		}();
+		
+		// 各个放置与其后的滑动都在同一个盘面上原地执行并撤销
+		float sum = 0;
+		int empty = 0;
+		board state = after;
+		board::undo placed, slid;
+		for (unsigned pos = 0; pos < board::cells; pos++) {
+			if (after(pos) != 0) continue;
+			empty++;
+			for (board::cell tile = 1; tile <= 2; tile++) {
+				float p = (tile == 2) ? four : 1 - four;
+				if (p == 0) continue;
+				state.make_place(pos, tile, placed);
+				float best = 0; // 无路可走
+				bool legal = false;
+				for (int op : opcode) {
+					board::reward reward = state.make_slide(op, slid);
+					if (reward == -1) continue;
+					float value = reward + (depth == 1 ? leaf(state, op, nodes) : expectimax(state, depth - 1, nodes));
+					state.unmake(slid);
+					if (!legal || value > best) best = value, legal = true;
+				}
+				state.unmake(placed);
+				sum += p * best;
+			}
+		}
+		float value = empty ? sum / empty : evaluate_action(after, after, 0);
+		if (entry && !expired) {
+			entry->nibble = key.nibble;
+			entry->high = key.high;
+			entry->depth = depth;
+			entry->stamp = table_stamp;
+			entry->value = value;
 		}
-		
 		return value;
 	}
 	
 	/**
-	 * 评估单个N-tuple模式
+	 * 叶节点的估值，与expectimax(after, 0, nodes)相同，但网络估值以滑动方向op的缓存增量计算
 	 */
-	float evaluate_pattern(const board& b, const std::vector<int>& pattern, const weight& weights) {
-		// 计算模式索引
-		size_t index = 0;
-		size_t multiplier = 1;
-		
-		for (int pos : pattern) {
-			if (pos >= 0 && pos < 16) {
-				// 获取瓦片值（对数形式），限制最大值为15（避免索引越界）
-				int tile_value = std::min(static_cast<int>(b(pos)), 15);
-				index += tile_value * multiplier;
-				multiplier *= 16; // 每个位置最多16种可能值（0-15）
-			}
-			
-			// 防止索引过大
-			if (index >= weights.size()) {
-				break;
-			}
-		}
-		
-		// 确保索引在有效范围内
-		if (index < weights.size()) {
-			return weights[index];
+	float leaf(const board& after, int op, size_t& nodes) {
+		if (timeout()) return 0;
+		nodes++;
+		if (after.is_win()) return calculate_final_reward("win");
+		if (leaf_stamp != table_stamp) {
+			for (ntuple::state& leaf : leaves) leaf.reset();
+			leaf_stamp = table_stamp;
 		}
-		
-		return 0.0f;
+		float base_value = weights().empty() ? 0 : features.estimate(after, weights(), leaves[op]);
+		return adjustment.apply(base_value, after);
 	}
 	
 	/**
-	 * 评估模式的同构变换（镜像和旋转）
+	 * 是否已超过本步的搜索时限，每16个节点检查一次时钟
 	 */
-	float evaluate_isomorphic_patterns(const board& b, const std::vector<int>& pattern, const weight& weights) {
-		float total_value = 0.0f;
-		
-		// 水平镜像
-		board mirrored_h = b;
-		mirror_horizontal(mirrored_h);
-		total_value += evaluate_pattern(mirrored_h, pattern, weights);
-		
-		// 垂直镜像
-		board mirrored_v = b;
-		mirror_vertical(mirrored_v);
-		total_value += evaluate_pattern(mirrored_v, pattern, weights);
-		
-		// 转置
-		board transposed = b;
-		transpose_board(transposed);
-		total_value += evaluate_pattern(transposed, pattern, weights);
-		
-		// 转置后镜像
-		mirror_horizontal(transposed);
-		total_value += evaluate_pattern(transposed, pattern, weights);
-		
-		mirror_vertical(transposed);
-		total_value += evaluate_pattern(transposed, pattern, weights);
-		
-		// 再次转置
-		transpose_board(transposed);
-		total_value += evaluate_pattern(transposed, pattern, weights);
-		
-		mirror_horizontal(transposed);
-		total_value += evaluate_pattern(transposed, pattern, weights);
-		
-		return total_value;
+	bool timeout() {
+		return deep_budget > 0 && (expired || ((++ticks & 15) == 0 && (expired = std::chrono::steady_clock::now() >= deadline)));
 	}
 	
 	/**
-	 * 棋盘变换函数
+	 * 迭代加深：从2层起逐层搜索直到limit层或时限到达，返回最后完成的层数，values为该层的结果
+	 * 每层按上一层的结果从好到坏搜索根节点走法；时限到达时，未完成一层中已搜索完的走法采用新的结果，
+	 * 其余走法保留上一层的结果，因此上一层的最佳走法总是最先得到更深的结果
+	 * 较浅的层写入的置换表项供较深的层与下一步复用
 	 */
-	void mirror_horizontal(board& b) {
-		for (int r = 0; r < 4; r++) {
-			std::swap(b(r*4 + 0), b(r*4 + 3));
-			std::swap(b(r*4 + 1), b(r*4 + 2));
+	unsigned iterate(const board& before, std::array<float, 4>& values, unsigned limit,
+			std::chrono::steady_clock::time_point begin, size_t& nodes) {
+		deadline = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(deep_budget));
+		expired = false;
+		std::array<int, 4> order = opcode;
+		unsigned done = 1;
+		board after = before;
+		board::undo undo;
+		for (unsigned depth = 2; depth <= limit && !expired; depth++) {
+			std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return values[a] > values[b]; });
+			std::array<float, 4> next = values;
+			for (int op : order) {
+				if (values[op] == -std::numeric_limits<float>::max()) continue;
+				board::reward reward = after.make_slide(op, undo);
+				float value = reward + expectimax(after, depth - 1, nodes);
+				after.unmake(undo);
+				if (expired) break;
+				next[op] = value;
+			}
+			values = next;
+			if (expired) break;
+			done = depth;
 		}
+		return done;
 	}
 	
-	void mirror_vertical(board& b) {
-		for (int c = 0; c < 4; c++) {
-			std::swap(b(0*4 + c), b(3*4 + c));
-			std::swap(b(1*4 + c), b(2*4 + c));
+	/**
+	 * 评估一个动作的价值：基础价值 + 策略调整
+	 */
+	float evaluate_action(const board& before, const board& after, board::reward reward) {
+		// 基础评估：合并奖励 + 权重网络评估（如果有的话）
+		float base_value = static_cast<float>(reward);
+		
+		// 如果网络已初始化，使用网络评估
+		if (!weights().empty()) {
+			base_value += evaluate_board(after);
 		}
+		
+		// 策略调整：危险度惩罚与存活奖励（更多空格 = 更好），与network::choose共用
+		return adjustment.apply(base_value, after);
 	}
 	
-	void transpose_board(board& b) {
-		for (int r = 0; r < 4; r++) {
-			for (int c = r + 1; c < 4; c++) {
-				std::swap(b(r*4 + c), b(c*4 + r));
-			}
-		}
+	/**
+	 * 使用完整的N-tuple网络评估棋盘状态
+	 * 每个模式及其8种同构变换各自查表后求和
+	 */
+	float evaluate_board(const board& b) {
+		return features.estimate(b, weights());
+	}
+
+	/**
+	 * 热重载：有权重表被替换时使置换表与叶节点缓存中以旧权重算出的值失效
+	 */
+	virtual int reload_weights(const std::string& path) override {
+		int replaced = weight_agent::reload_weights(path);
+		if (replaced > 0) table_stamp++;
+		return replaced;
+	}
+	
+	/**
+	 * 权重是否符合特征：记录的cap（如有）需相同，表大小需为cap^n
+	 */
+	virtual std::string misfit(const std::vector<weight>& tables) const override {
+		return table_misfit(features, tables);
+	}
+
+	/**
+	 * 对局使用的权重：异步学习时为固定的快照，否则为自己的权重
+	 */
+	const std::vector<weight>& weights() const {
+		return pinned ? *pinned : net;
 	}
 
 	void save_game_record(bool is_win) {
+		if (!record_games) return;
 		std::string filename = is_win ? "win_games.log" : "normal_games.log";
 		std::ofstream file(filename, std::ios::app);
 		if (file.is_open()) {
@@ -644,43 +1064,26 @@ private:
 	void update_weights_with_td_error(const board& state, float td_error) {
 		if (net.empty() || eligibility_traces.empty()) return;
 		
-		// 定义N-tuple模式
-		static const std::vector<std::vector<int>> patterns = {
-			{0, 1, 4, 5},   // 左上角2x2
-			{2, 3, 6, 7},   // 右上角2x2  
-			{8, 9, 12, 13}, // 左下角2x2
-			{10, 11, 14, 15} // 右下角2x2
-		};
-		
 		// 对每个模式进行权重更新
-		for (size_t i = 0; i < std::min(patterns.size(), net.size()); i++) {
+		for (size_t i = 0; i < std::min(features.tuples(), net.size()); i++) {
 			if (net[i].size() == 0) continue;
 			
-			// 更新原始模式
-			update_pattern_weights(state, patterns[i], i, td_error);
-			
-			// 更新同构变换
-			update_isomorphic_pattern_weights(state, patterns[i], i, td_error);
+			for (const auto& iso : update_rule()) {
+				update_feature_weight(i, features.index(state, i * ntuple::isomorphisms + iso.first), td_error * iso.second);
+			}
 		}
 	}
 	
-	// 更新单个模式的权重
-	void update_pattern_weights(const board& state, const std::vector<int>& pattern, 
-	                           size_t net_index, float td_error) {
-		// 计算模式索引
-		size_t index = 0;
-		size_t multiplier = 1;
-		
-		for (int pos : pattern) {
-			if (pos >= 0 && pos < 16) {
-				int tile_value = std::min(static_cast<int>(state(pos)), 15);
-				index += tile_value * multiplier;
-				multiplier *= 16;
-			}
-			
-			if (index >= net[net_index].size()) break;
-		}
-		
+	// 每个模式更新的同构变换及其步长比例
+	// 原始模式完整更新；为了简化，同构变换只更新水平镜像(1)与转置(3)两种，按8种变换均分
+	// 完整版本应该包含所有8种变换
+	static const td_learner::update_rule& update_rule() {
+		static const td_learner::update_rule rule = { { 0, 1.0f }, { 1, 0.125f }, { 3, 0.125f } };
+		return rule;
+	}
+	
+	// 更新单个特征的权重
+	void update_feature_weight(size_t net_index, size_t index, float td_error) {
 		// 更新权重和资格迹（安全检查）
 		if (index < net[net_index].size()) {
 			// 如果索引在资格迹范围内，设置资格迹
@@ -690,24 +1093,38 @@ private:
 				trace_value = eligibility_traces[net_index][index];
 			}
 			
-			// TD(λ)权重更新
-			net[net_index][index] += alpha * td_error * trace_value;
+			// TD(λ)权重更新（批量模式下先累积，之后的评估使用尚未更新的权重）
+			if (batch_games) {
+				batch.add(net_index, index, alpha * td_error * trace_value);
+			} else {
+				net[net_index][index] += alpha * td_error * trace_value;
+			}
 		}
 	}
 	
-	// 更新同构变换模式的权重
-	void update_isomorphic_pattern_weights(const board& state, const std::vector<int>& pattern,
-	                                     size_t net_index, float td_error) {
-		// 为了简化，这里只实现水平镜像的权重更新
-		// 完整版本应该包含所有8种变换
-		
-		board mirrored = state;
-		mirror_horizontal(mirrored);
-		update_pattern_weights(mirrored, pattern, net_index, td_error * 0.125f); // 8种变换均分
-		
-		board transposed = state;
-		transpose_board(transposed);
-		update_pattern_weights(transposed, pattern, net_index, td_error * 0.125f);
+	// 按元组内最大瓦片（其次按原索引）排序，最大瓦片小于m的组合（m^n不超过hot时）都落在前m^n个位置
+	void remap_by_tile_rank() {
+		for (size_t i = 0; i < std::min(features.tuples(), net.size()); i++) {
+			if (net[i].size() >= (size_t(1) << 32) || net[i].is_paged()) continue;
+			size_t length = features.length(i), cap = features.cap();
+			net[i].remap(weight::rank(net[i].size(), [=](uint32_t index) {
+				size_t top = 0;
+				for (size_t k = 0, v = index; k < length; k++, v /= cap) top = std::max(top, v % cap);
+				return top;
+			}, hot_entries));
+		}
+	}
+	
+	// 按访问次数从多到少排序
+	void remap_by_visits() {
+		batch.apply(net);
+		for (size_t i = 0; i < visits.size(); i++) {
+			const auto& count = visits[i];
+			if (count.empty()) continue;
+			size_t visited = count.size() - std::count(count.begin(), count.end(), 0u);
+			net[i].remap(weight::rank(count.size(), [&](uint32_t index) { return ~count[index]; }, std::min(hot_entries, visited)));
+		}
+		visits.clear();
 	}
 	
 	// 计算游戏结束时的最终奖励
@@ -742,27 +1159,9 @@ private:
 	std::vector<std::vector<size_t>> extract_all_features(const board& state) {
 		std::vector<std::vector<size_t>> all_features;
 		
-		static const std::vector<std::vector<int>> patterns = {
-			{0, 1, 4, 5}, {2, 3, 6, 7}, {8, 9, 12, 13}, {10, 11, 14, 15}
-		};
-		
-		for (const auto& pattern : patterns) {
-			std::vector<size_t> features;
-			
-			// 计算原始模式索引
-			size_t index = 0;
-			size_t multiplier = 1;
-			
-			for (int pos : pattern) {
-				if (pos >= 0 && pos < 16) {
-					int tile_value = std::min(static_cast<int>(state(pos)), 15);
-					index += tile_value * multiplier;
-					multiplier *= 16;
-				}
-			}
-			
-			features.push_back(index);
-			all_features.push_back(features);
+		// 计算原始模式索引
+		for (size_t i = 0; i < features.tuples(); i++) {
+			all_features.push_back({ features.index(state, i * ntuple::isomorphisms + 0) });
 		}
 		
 		return all_features;
@@ -772,16 +1171,57 @@ public:
 	// 公共接口用于调整学习参数
 	void set_learning_rate(float new_alpha) { alpha = new_alpha; }
 	void set_lambda(float new_lambda) { lambda = new_lambda; }
-	void set_danger_penalty_factor(float new_penalty) { danger_penalty_factor = new_penalty; }
-	void set_survival_bonus(float new_bonus) { survival_bonus = new_bonus; }
+	void set_danger_penalty_factor(float new_penalty) { adjustment.penalty = new_penalty; }
+	void set_survival_bonus(float new_bonus) { adjustment.bonus = new_bonus; }
+	const strategy& get_strategy() const { return adjustment; }
 	void set_learning_enabled(bool enabled) { enable_learning = enabled; }
 	
 	// 获取学习统计信息
 	size_t get_episode_length() const { return current_episode.size(); }
 	float get_current_learning_rate() const { return alpha; }
 	bool is_learning_enabled() const { return enable_learning; }
+	const ntuple& get_features() const { return features; }
+	const std::vector<weight>& get_weights() const { return weights(); }
+	
+	/**
+	 * 以最新的主权重调用visit（例如保存）：异步学习时等学习线程处理完已提交的轨迹，否则先写入累积的批量更新
+	 */
+	template<class visitor>
+	void visit_master(visitor visit) {
+		if (learner) return learner->inspect(visit);
+		batch.apply(net);
+		visit(static_cast<const std::vector<weight>&>(net));
+	}
 	
 private:
+	/**
+	 * 按危险度分档的搜索开销，例如
+	 * "[加深] 危险0: 决策=9000 加深=3.1% 每步=15us 节点=120/步 | 危险0.4: ..."
+	 */
+	void post_effort() const {
+		static const char* bucket[] = { "0", "0.4", "0.7", "1" };
+		std::stringstream line;
+		line << std::fixed << "[加深]";
+		bool first = true;
+		for (size_t i = 0; i < efforts.size(); i++) {
+			const effort& e = efforts[i];
+			if (!e.moves) continue;
+			line << (first ? "" : " |") << " 危险" << bucket[i] << ": 决策=" << e.moves;
+			first = false;
+			line << std::setprecision(1) << " 加深=" << (100.0 * e.deepened / e.moves) << "%";
+			line << std::setprecision(0) << " 每步=" << (e.time * 1e6 / e.moves) << "us";
+			line << " 节点=" << (double(e.nodes) / e.moves) << "/步";
+		}
+		if (deep_budget > 0) {
+			// 迭代加深在时限内完成各层数的比例
+			size_t total = std::accumulate(completed.begin(), completed.end(), size_t(0));
+			line << " | 完成层数";
+			for (size_t d = 1; d < completed.size() && total; d++)
+				if (completed[d]) line << std::setprecision(1) << " " << d << "=" << (100.0 * completed[d] / total) << "%";
+		}
+		metrics::global().post("加深", line.str());
+	}
+	
 	// 显示学习摘要
 	void show_learning_summary(const std::string& flag) {
 		if (!enable_learning) return;
@@ -819,6 +1259,39 @@ private:
 			if (alpha > 0) {
 				std::cout << " 学习率=" << alpha;
 			}
+			if (learner) {
+				// 队列深度、对局线程等待时间与学习线程工作时间，用于平衡对局与学习的CPU
+				std::cout << " [异步学习] 已学习=" << learner->count()
+				          << " 队列深度=" << std::setprecision(1) << learner->mean_depth()
+				          << "/" << learner->max_depth() << "/" << learner->capacity()
+				          << " 等待=" << std::setprecision(0) << learner->blocked_time() << "ms"
+				          << " 学习耗时=" << learner->busy_time() << "ms"
+				          << " 快照=" << learner->snapshots().count()
+				          << " 发布耗时=" << std::setprecision(2) << learner->snapshots().mean_latency()
+				          << "/" << learner->snapshots().max_latency() << "ms"
+				          << " 快照内存=" << learner->snapshots().live() << "/" << learner->snapshots().peak()
+				          << "份 " << (learner->snapshots().bytes() >> 10) << "KB";
+			}
+			if (!learner && !paged_bytes && !net.empty()) {
+				// 各权重表实际驻留内存的比例，即训练触及的部分
+				std::cout << " [驻留]";
+				for (const weight& w : net)
+					std::cout << " " << std::setprecision(1) << (w.size() ? 100.0 * w.resident_bytes() / (w.size() * sizeof(weight::type)) : 0) << "%";
+			}
+			if (paged_bytes && !learner) {
+				// 分页权重表：驻留页数/峰值、缺页分配次数与淘汰次数
+				weight::paging sum = weight::paging();
+				size_t bytes = 0;
+				for (const weight& w : net) {
+					sum.resident += w.paging_stat().resident;
+					sum.peak += w.paging_stat().peak;
+					sum.faults += w.paging_stat().faults;
+					sum.evicted += w.paging_stat().evicted;
+					bytes += w.resident_bytes();
+				}
+				std::cout << " [分页] 驻留=" << sum.resident << "/" << sum.peak << "页 (" << (bytes >> 20) << "MB)"
+				          << " 分配=" << sum.faults << " 淘汰=" << sum.evicted;
+			}
 			std::cout << std::endl;
 			
 			// 重置统计
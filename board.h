@@ -14,54 +14,93 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <string>
+#include "rules.h"
 
 /**
- * array-based board for 2048
+ * array-based board for 2048 and its variants, parametrized by compile-time game rules
+ * the dimensions, the win predicate, and the spawn distribution are given by 'game'
  *
- * index (1-d form):
+ * index (1-d form) of the standard 4x4 board:
  *  (0)  (1)  (2)  (3)
  *  (4)  (5)  (6)  (7)
  *  (8)  (9) (10) (11)
  * (12) (13) (14) (15)
  *
  */
-class board {
+template<class game>
+class basic_board {
 public:
+	typedef game rules;
+	static constexpr unsigned rows = rules::rows;
+	static constexpr unsigned cols = rules::cols;
+	static constexpr unsigned cells = rules::cells;
+	static constexpr unsigned span = rows > cols ? rows : cols; // the max length of lines
+
 	typedef uint32_t cell;
-	typedef std::array<cell, 4> row;
-	typedef std::array<row, 4> grid;
+	typedef std::array<cell, cols> row;
+	typedef std::array<row, rows> grid;
 	typedef uint64_t data;
 	typedef uint64_t score;
 	typedef int reward;
 
 public:
-	board() : tile(), attr(0) {}
-	board(const grid& b, data v = 0) : tile(b), attr(v) {}
-	board(const board& b) = default;
-	board& operator =(const board& b) = default;
+	basic_board() : tile(), attr(0) {}
+	basic_board(const grid& b, data v = 0) : tile(b), attr(v) {}
+	basic_board(const basic_board& b) = default;
+	basic_board& operator =(const basic_board& b) = default;
 
 	operator grid&() { return tile; }
 	operator const grid&() const { return tile; }
 	row& operator [](unsigned i) { return tile[i]; }
 	const row& operator [](unsigned i) const { return tile[i]; }
-	cell& operator ()(unsigned i) { return tile[i / 4][i % 4]; }
-	const cell& operator ()(unsigned i) const { return tile[i / 4][i % 4]; }
+	cell& operator ()(unsigned i) { return tile[i / cols][i % cols]; }
+	const cell& operator ()(unsigned i) const { return tile[i / cols][i % cols]; }
 
 	cell* begin() { return &(operator()(0)); }
 	const cell* begin() const { return &(operator()(0)); }
-	cell* end() { return begin() + 16; }
-	const cell* end() const { return begin() + 16; }
+	cell* end() { return begin() + cells; }
+	const cell* end() const { return begin() + cells; }
 
 	data info() const { return attr; }
 	data info(data dat) { data old = attr; attr = dat; return old; }
 
 public:
-	bool operator ==(const board& b) const { return tile == b.tile; }
-	bool operator < (const board& b) const { return tile <  b.tile; }
-	bool operator !=(const board& b) const { return !(*this == b); }
-	bool operator > (const board& b) const { return b < *this; }
-	bool operator <=(const board& b) const { return !(b < *this); }
-	bool operator >=(const board& b) const { return !(*this < b); }
+	/**
+	 * packed board for boards with up to 16 cells
+	 * 'nibble' keeps the lower 4 bits of each tile, cell i at bits [4i, 4i+4)
+	 * 'high' is the overflow channel, bit i is set if tile i is 16 (65536-tile) or larger
+	 * i.e., each tile is stored in 5 bits, supporting tiles up to 2^31
+	 */
+	struct packed {
+		uint64_t nibble;
+		uint16_t high;
+		bool operator ==(const packed& p) const { return nibble == p.nibble && high == p.high; }
+		bool operator !=(const packed& p) const { return !(*this == p); }
+	};
+
+	basic_board(const packed& p) : tile(), attr(0) {
+		static_assert(cells <= 16, "packed board supports up to 16 cells");
+		for (unsigned i = 0; i < cells; i++)
+			operator()(i) = ((p.nibble >> (i * 4)) & 0x0f) | (((p.high >> i) & 1) << 4);
+	}
+	packed pack() const {
+		static_assert(cells <= 16, "packed board supports up to 16 cells");
+		packed p = { 0, 0 };
+		for (unsigned i = 0; i < cells; i++) {
+			p.nibble |= uint64_t(operator()(i) & 0x0f) << (i * 4);
+			p.high |= uint16_t((operator()(i) >> 4) & 1) << i;
+		}
+		return p;
+	}
+
+public:
+	bool operator ==(const basic_board& b) const { return tile == b.tile; }
+	bool operator < (const basic_board& b) const { return tile <  b.tile; }
+	bool operator !=(const basic_board& b) const { return !(*this == b); }
+	bool operator > (const basic_board& b) const { return b < *this; }
+	bool operator <=(const basic_board& b) const { return !(b < *this); }
+	bool operator >=(const basic_board& b) const { return !(*this < b); }
 
 public:
 
@@ -70,7 +109,7 @@ public:
 	 * return 0 if the action is valid, or -1 if not
 	 */
 	reward place(unsigned pos, cell tile) {
-		if (pos >= 16 || operator()(pos)) return -1;
+		if (pos >= cells || operator()(pos)) return -1;
 		if (tile != 1 && tile != 2) return -1;
 		operator()(pos) = tile;
 		return 0;
@@ -90,52 +129,129 @@ public:
 		}
 	}
 
-	reward slide_left() {
-		board prev = *this;
+	reward slide_up() { undo u; return make_slide<0>(u); }
+	reward slide_right() { undo u; return make_slide<1>(u); }
+	reward slide_down() { undo u; return make_slide<2>(u); }
+	reward slide_left() { undo u; return make_slide<3>(u); }
+
+public:
+	/**
+	 * undo record for make/unmake, i.e., applying and undoing a move in place
+	 * a slide keeps the changed lines (rows or columns), one byte per cell
+	 * a placement keeps only the position of the placed tile
+	 * the record of a rejected action undoes nothing, thus unmake may follow any make
+	 */
+	struct undo {
+		uint8_t op;   // the sliding opcode (0-3), or 4 for a placement
+		uint8_t mask; // bit i is set if line i is changed, or the position of a placement
+		std::array<std::array<uint8_t, span>, span> line;
+	};
+
+	/**
+	 * apply a sliding action in place and fill the undo record
+	 * return the reward of the action, or -1 if the action is illegal (the board is unchanged)
+	 */
+	reward make_slide(unsigned opcode, undo& u) {
+		switch (opcode & 0b11) {
+		default:
+		case 0: return make_slide<0>(u);
+		case 1: return make_slide<1>(u);
+		case 2: return make_slide<2>(u);
+		case 3: return make_slide<3>(u);
+		}
+	}
+
+	template<unsigned opcode>
+	reward make_slide(undo& u) {
+		constexpr unsigned lines = (opcode & 1) ? rows : cols;
+		constexpr unsigned length = (opcode & 1) ? cols : rows;
+		u.op = opcode;
+		u.mask = 0;
 		reward score = 0;
-		for (int r = 0; r < 4; r++) {
-			auto& row = tile[r];
+		for (unsigned i = 0; i < lines; i++) {
+			cell* line[length];
+			bool moved = false;
+			for (unsigned k = 0; k < length; k++) line[k] = &operator()(index<opcode>(i, k));
+			for (unsigned k = 0; k < length; k++) u.line[i][k] = *line[k];
 			int top = 0, hold = 0;
-			for (int c = 0; c < 4; c++) {
-				int tile = row[c];
+			for (unsigned k = 0; k < length; k++) {
+				int tile = *line[k];
 				if (tile == 0) continue;
-				row[c] = 0;
+				*line[k] = 0;
 				if (hold) {
 					if (tile == hold) {
-						row[top++] = ++tile;
+						*line[top++] = ++tile;
 						score += (1 << tile);
 						hold = 0;
 					} else {
-						row[top++] = hold;
+						*line[top++] = hold;
 						hold = tile;
 					}
 				} else {
 					hold = tile;
 				}
 			}
-			if (hold) tile[r][top] = hold;
+			if (hold) *line[top] = hold;
+			for (unsigned k = 0; k < length; k++) moved |= (*line[k] != u.line[i][k]);
+			u.mask |= (moved << i);
+		}
+		return u.mask ? score : -1;
+	}
+
+	/**
+	 * place a tile in place and fill the undo record
+	 * return 0 if the action is valid, or -1 if not (the board is unchanged)
+	 */
+	reward make_place(unsigned pos, cell tile, undo& u) {
+		if (place(pos, tile) == -1) {
+			u.op = 0; // a slide without changed lines
+			u.mask = 0;
+			return -1;
 		}
-		return (*this != prev) ? score : -1;
+		u.op = 4;
+		u.mask = pos;
+		return 0;
 	}
-	reward slide_right() {
-		reflect_horizontal();
-		reward score = slide_left();
-		reflect_horizontal();
-		return score;
+
+	/**
+	 * undo an action applied by make_slide or make_place
+	 */
+	void unmake(const undo& u) {
+		if (u.op == 4) {
+			operator()(u.mask) = 0;
+			return;
+		}
+		for (unsigned i = 0; i < span; i++) {
+			if (!(u.mask & (1 << i))) continue;
+			for (unsigned k = 0; k < ((u.op & 1) ? cols : rows); k++) operator()(index(u.op, i, k)) = u.line[i][k];
+		}
 	}
-	reward slide_up() {
-		rotate_clockwise();
-		reward score = slide_right();
-		rotate_counterclockwise();
-		return score;
+
+	/**
+	 * the 1-d index of the k-th cell of a line, ordered toward the sliding direction
+	 * e.g., line 1 of sliding right (opcode 1) on the standard board is (7) (6) (5) (4)
+	 */
+	template<unsigned opcode>
+	static constexpr unsigned index(unsigned line, unsigned k) {
+		return (opcode & 0b11) == 0 ? k * cols + line :
+		       (opcode & 0b11) == 1 ? line * cols + (cols - 1 - k) :
+		       (opcode & 0b11) == 2 ? (rows - 1 - k) * cols + line :
+		                              line * cols + k;
 	}
-	reward slide_down() {
-		rotate_clockwise();
-		reward score = slide_left();
-		rotate_counterclockwise();
-		return score;
+	static unsigned index(unsigned opcode, unsigned line, unsigned k) {
+		switch (opcode & 0b11) {
+		default:
+		case 0: return index<0>(line, k);
+		case 1: return index<1>(line, k);
+		case 2: return index<2>(line, k);
+		case 3: return index<3>(line, k);
+		}
 	}
 
+public:
+	/**
+	 * rotations and transposition are only available on square boards
+	 */
 	void rotate(int clockwise_count = 1) {
 		switch (((clockwise_count % 4) + 4) % 4) {
 		default:
@@ -151,22 +267,19 @@ public:
 	void reverse() { reflect_horizontal(); reflect_vertical(); }
 
 	void reflect_horizontal() {
-		for (int r = 0; r < 4; r++) {
-			std::swap(tile[r][0], tile[r][3]);
-			std::swap(tile[r][1], tile[r][2]);
+		for (unsigned r = 0; r < rows; r++) {
+			std::reverse(tile[r].begin(), tile[r].end());
 		}
 	}
 
 	void reflect_vertical() {
-		for (int c = 0; c < 4; c++) {
-			std::swap(tile[0][c], tile[3][c]);
-			std::swap(tile[1][c], tile[2][c]);
-		}
+		std::reverse(tile.begin(), tile.end());
 	}
 
 	void transpose() {
-		for (int r = 0; r < 4; r++) {
-			for (int c = r + 1; c < 4; c++) {
+		static_assert(rows == cols, "transpose requires a square board");
+		for (unsigned r = 0; r < rows; r++) {
+			for (unsigned c = r + 1; c < cols; c++) {
 				std::swap(tile[r][c], tile[c][r]);
 			}
 		}
@@ -174,25 +287,18 @@ public:
 
 public:
 	/**
-	 * 检测是否有两个8192瓦片 (胜利条件)
-	 * 8192 = 2^13, 所以检测值为13
+	 * test the win predicate of the rules
 	 */
-	bool has_two_8192() const {
-		int count_8192 = 0;
-		for (int i = 0; i < 16; i++) {
-			if (operator()(i) == 13) { // 2^13 = 8192
-				count_8192++;
-			}
-		}
-		return count_8192 >= 2;
+	bool is_win() const {
+		return rules::win::test(*this);
 	}
-	
+
 	/**
 	 * 计算特定数值瓦片的数量
 	 */
 	int count_tile_value(cell value) const {
 		int count = 0;
-		for (int i = 0; i < 16; i++) {
+		for (unsigned i = 0; i < cells; i++) {
 			if (operator()(i) == value) {
 				count++;
 			}
@@ -205,7 +311,7 @@ public:
 	 */
 	int max_tile_value() const {
 		int max_val = 0;
-		for (int i = 0; i < 16; i++) {
+		for (unsigned i = 0; i < cells; i++) {
 			max_val = std::max(max_val, static_cast<int>(operator()(i)));
 		}
 		return max_val;
@@ -213,31 +319,36 @@ public:
 	
 	/**
 	 * 计算危险程度 (接近胜利条件的程度)
+	 * 门槛由胜利条件推出：差一个目标瓦片 (标准规则为已有一个8192) 且有次一级瓦片 (4096) 时危险
 	 * 返回值: 0.0 = 安全, 1.0 = 极度危险
 	 */
 	float calculate_danger_level() const {
-		int count_8192 = count_tile_value(13); // 8192
-		int count_4096 = count_tile_value(12); // 4096
+		typedef typename rules::win win;
+		if (win::target == 0 || win::needed == 0) return 0.0f; // 没有胜利条件
+		int count_top = count_tile_value(win::target);      // 8192
+		int count_next = count_tile_value(win::target - 1); // 4096
+		bool one_short = count_top + 1 >= int(win::needed);
 		
-		if (count_8192 >= 1 && count_4096 >= 2) return 1.0f; // 极高危险
-		if (count_8192 >= 1 && count_4096 >= 1) return 0.7f; // 高危险
-		if (count_4096 >= 3) return 0.4f; // 中等危险
+		if (one_short && count_next >= 2) return 1.0f; // 极高危险
+		if (one_short && count_next >= 1) return 0.7f; // 高危险
+		if (count_next >= 3) return 0.4f; // 中等危险
 		return 0.0f; // 安全
 	}
 
 public:
-	friend std::ostream& operator <<(std::ostream& out, const board& b) {
-		out << "+------------------------+" << std::endl;
+	friend std::ostream& operator <<(std::ostream& out, const basic_board& b) {
+		const std::string border = "+" + std::string(cols * 6, '-') + "+";
+		out << border << std::endl;
 		for (auto& row : b.tile) {
 			out << "|" << std::dec;
 			for (auto t : row) out << std::setw(6) << ((1 << t) & -2u);
 			out << "|" << std::endl;
 		}
-		out << "+------------------------+" << std::endl;
+		out << border << std::endl;
 		return out;
 	}
-	friend std::istream& operator >>(std::istream& in, board& b) {
-		for (int i = 0; i < 16; i++) {
+	friend std::istream& operator >>(std::istream& in, basic_board& b) {
+		for (unsigned i = 0; i < cells; i++) {
 			while (!std::isdigit(in.peek()) && in.good()) in.ignore(1);
 			in >> b(i);
 			b(i) = std::log2(b(i));
@@ -249,3 +360,10 @@ private:
 	grid tile;
 	data attr;
 };
+
+template<class game> constexpr unsigned basic_board<game>::rows;
+template<class game> constexpr unsigned basic_board<game>::cols;
+template<class game> constexpr unsigned basic_board<game>::cells;
+template<class game> constexpr unsigned basic_board<game>::span;
+
+typedef basic_board<rules::standard> board;
@@ -0,0 +1,518 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * checkpoint.h: Parallel load and save of weight tables with positional I/O
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "weight.h"
+
+/**
+ * checkpoint file of weight tables, laid out for concurrent positional I/O
+ *
+ * header: magic "NTW2", version, number of tables, flags (all uint32)
+ * the low 8 bits of the flags are the tile cap of the indices (see ntuple), 0 if not recorded
+ * then for each table: offset and size of its entries, offset and size of its hot list (all uint64, see hot_map)
+ * the entries of each table start at a 4096-byte boundary and are stored in slot order
+ *
+ * the tables are split into chunks, which are read or written by a pool of threads with pread/pwrite
+ * a paged table is handled by one thread as a whole, since allocating its pages is not thread-safe
+ * with 'direct', the entries bypass the page cache (O_DIRECT) through aligned buffers
+ */
+namespace checkpoint {
+
+static constexpr uint32_t magic = 0x3257544e; // "NTW2"
+static constexpr uint32_t sparse_magic = 0x5357544e; // "NTWS", see export_runs
+static constexpr uint32_t version = 1;
+static constexpr uint64_t alignment = 4096;
+static constexpr size_t chunk = size_t(1) << 22; // entries per task
+
+struct header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t flags;
+};
+
+struct entry {
+	uint64_t offset;
+	uint64_t size;
+	uint64_t order_offset;
+	uint64_t order_size;
+};
+
+/**
+ * a range of entries of a table, and where it is in the file
+ */
+struct task {
+	size_t table;
+	size_t begin;
+	size_t num;
+	uint64_t offset;
+};
+
+inline uint64_t align(uint64_t n) { return (n + alignment - 1) / alignment * alignment; }
+
+/**
+ * whether 'count' items of 'unit' bytes from 'offset' are within a file of 'length' bytes, without overflow
+ */
+inline bool within(uint64_t offset, uint64_t count, uint64_t unit, uint64_t length) {
+	return offset <= length && count <= (length - offset) / unit;
+}
+
+/**
+ * the tile cap shared by the tables, which is kept in the flags of the header
+ */
+inline uint32_t cap_of(const std::vector<weight>& net) { return net.empty() ? 0 : (net[0].cap() & 0xff); }
+inline void set_cap(std::vector<weight>& net, uint32_t cap) {
+	for (weight& w : net) w.cap(cap);
+}
+
+inline bool pwrite_all(int fd, const void* buf, size_t len, uint64_t offset) {
+	for (const char* p = static_cast<const char*>(buf); len; ) {
+		ssize_t n = ::pwrite(fd, p, len, offset);
+		if (n <= 0) return false;
+		p += n, len -= n, offset += n;
+	}
+	return true;
+}
+
+inline bool pread_all(int fd, void* buf, size_t len, uint64_t offset) {
+	for (char* p = static_cast<char*>(buf); len; ) {
+		ssize_t n = ::pread(fd, p, len, offset);
+		if (n <= 0) return false;
+		p += n, len -= n, offset += n;
+	}
+	return true;
+}
+
+inline int open_direct(const std::string& path, int flags, bool direct) {
+#ifdef O_DIRECT
+	if (direct) {
+		int fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+		if (fd >= 0) return fd;
+	}
+#endif
+	return ::open(path.c_str(), flags, 0644);
+}
+
+/**
+ * split the tables into tasks, dense tables in chunks and paged tables as a whole
+ */
+inline std::vector<task> split(const std::vector<weight>& net, const std::vector<entry>& index) {
+	std::vector<task> tasks;
+	for (size_t t = 0; t < net.size(); t++) {
+		size_t step = net[t].is_paged() ? std::max<size_t>(index[t].size, 1) : chunk;
+		for (size_t begin = 0; begin < index[t].size; begin += step) {
+			size_t num = std::min<size_t>(step, index[t].size - begin);
+			tasks.push_back({ t, begin, num, index[t].offset + begin * sizeof(weight::type) });
+		}
+	}
+	// the largest tasks first, so that a long paged table does not finish last
+	std::stable_sort(tasks.begin(), tasks.end(), [](const task& a, const task& b) { return a.num > b.num; });
+	return tasks;
+}
+
+/**
+ * run the tasks by 'threads' workers, each with its own aligned buffer
+ * return false if any task fails
+ */
+template<class job>
+bool run(const std::vector<task>& tasks, unsigned threads, job work) {
+	std::atomic<size_t> next(0);
+	std::atomic<bool> ok(true);
+	auto worker = [&]() {
+		lazy_array<weight::type> buffer(chunk); // mapped, hence page-aligned for O_DIRECT
+		for (size_t i; ok && (i = next++) < tasks.size(); ) {
+			if (!work(tasks[i], buffer.data())) ok = false;
+		}
+	};
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < std::max(threads, 1u); i++) pool.emplace_back(worker);
+	worker();
+	for (std::thread& th : pool) th.join();
+	return ok;
+}
+
+/**
+ * whether a file is a checkpoint (or a sparse export), otherwise it may be in the legacy stream format
+ */
+inline bool detect(const std::string& path, uint32_t kind = magic) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	header head;
+	bool res = pread_all(fd, &head, sizeof(head), 0) && head.magic == kind;
+	::close(fd);
+	return res;
+}
+
+/**
+ * save the tables, return false on failure
+ */
+inline bool save(const std::string& path, const std::vector<weight>& net, unsigned threads, bool direct = false) {
+	std::vector<entry> index(net.size());
+	uint64_t offset = sizeof(header) + sizeof(entry) * net.size();
+	for (size_t t = 0; t < net.size(); t++) {
+		index[t].order_offset = offset;
+		index[t].order_size = net[t].remapping().size();
+		offset += sizeof(uint32_t) * index[t].order_size;
+	}
+	for (size_t t = 0; t < net.size(); t++) {
+		offset = align(offset);
+		index[t].offset = offset;
+		index[t].size = net[t].size();
+		offset += sizeof(weight::type) * index[t].size;
+	}
+
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+	header head = { magic, version, uint32_t(net.size()), cap_of(net) };
+	bool ok = pwrite_all(fd, &head, sizeof(head), 0);
+	ok = ok && pwrite_all(fd, index.data(), sizeof(entry) * index.size(), sizeof(head));
+	for (size_t t = 0; ok && t < net.size(); t++)
+		ok = pwrite_all(fd, net[t].remapping().data(), sizeof(uint32_t) * index[t].order_size, index[t].order_offset);
+	ok = ok && ::ftruncate(fd, offset) == 0;
+
+	int data = direct ? open_direct(path, O_WRONLY, true) : fd;
+	ok = ok && data >= 0 && run(split(net, index), threads, [&](const task& k, weight::type* buffer) {
+		const weight& w = net[k.table];
+		for (size_t i = 0; i < k.num; i += chunk) {
+			size_t num = std::min(chunk, k.num - i), len = sizeof(weight::type) * num;
+			uint64_t at = k.offset + sizeof(weight::type) * i;
+			if (!direct && !w.is_paged()) {
+				if (!pwrite_all(data, w.data() + k.begin + i, len, at)) return false;
+				continue;
+			}
+			w.export_range(k.begin + i, num, buffer);
+			if (direct) { // pad to the alignment, and cut the file to size afterward
+				std::fill(buffer + num, buffer + align(len) / sizeof(weight::type), weight::type(0));
+				len = align(len);
+			}
+			if (!pwrite_all(data, buffer, len, at)) return false;
+		}
+		return true;
+	});
+	if (data >= 0 && data != fd) ::close(data);
+	ok = ok && ::ftruncate(fd, offset) == 0;
+	::close(fd);
+	return ok;
+}
+
+/**
+ * load the tables, return false on failure or if the file is not a checkpoint
+ * tables already in 'net' keep whether they are paged; new tables are dense unless 'paged_bytes' is given
+ * the sizes in the header are checked against the file before anything is allocated, thus a corrupt
+ * or truncated file fails here and leaves 'net' as it was
+ */
+inline bool load(const std::string& path, std::vector<weight>& net, unsigned threads, bool direct = false, size_t paged_bytes = 0) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	header head;
+	struct stat st;
+	if (!pread_all(fd, &head, sizeof(head), 0) || head.magic != magic || head.version != version || ::fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+	uint64_t length = st.st_size;
+	bool ok = within(sizeof(head), head.count, sizeof(entry), length);
+	std::vector<entry> index(ok ? head.count : 0);
+	ok = ok && pread_all(fd, index.data(), sizeof(entry) * index.size(), sizeof(head));
+	for (size_t t = 0; ok && t < index.size(); t++)
+		ok = within(index[t].offset, index[t].size, sizeof(weight::type), length)
+			&& within(index[t].order_offset, index[t].order_size, sizeof(uint32_t), length);
+	if (!ok) {
+		::close(fd);
+		return false;
+	}
+	for (size_t t = net.size(); t < head.count; t++) {
+		net.emplace_back();
+		if (paged_bytes) net.back().page(0, paged_bytes);
+	}
+	net.resize(head.count);
+	for (size_t t = 0; ok && t < net.size(); t++) {
+		net[t].reset(index[t].size);
+		std::vector<uint32_t> order(index[t].order_size);
+		ok = pread_all(fd, order.data(), sizeof(uint32_t) * order.size(), index[t].order_offset);
+		ok = ok && net[t].remap(order, false);
+	}
+	set_cap(net, head.flags & 0xff);
+
+	int data = direct ? open_direct(path, O_RDONLY, true) : fd;
+	ok = ok && data >= 0 && run(split(net, index), threads, [&](const task& k, weight::type* buffer) {
+		weight& w = net[k.table];
+		for (size_t i = 0; i < k.num; i += chunk) {
+			size_t num = std::min(chunk, k.num - i), len = sizeof(weight::type) * num;
+			uint64_t at = k.offset + sizeof(weight::type) * i;
+			if (!direct && !w.is_paged()) {
+				if (!pread_all(data, w.data() + k.begin + i, len, at)) return false;
+				continue;
+			}
+			if (direct) { // the padding of the last chunk may be cut off at the end of the file
+				if (::pread(data, buffer, align(len), at) < ssize_t(len)) return false;
+			} else if (!pread_all(data, buffer, len, at)) {
+				return false;
+			}
+			w.import_range(k.begin + i, num, buffer);
+		}
+		return true;
+	});
+	if (data >= 0 && data != fd) ::close(data);
+	::close(fd);
+	return ok;
+}
+
+/**
+ * sparse export, which keeps only the non-zero runs of the tables, e.g., for distributing trained weights
+ *
+ * header: magic "NTWS", version, number of tables, flags (all uint32), the flags as in the checkpoint
+ * then for each table: its size and the size of its hot list (uint64), the hot list (uint32),
+ * and its runs in slot order, each as offset (uint64), length (uint32), and the entries,
+ * terminated by a run of length 0
+ * zero gaps shorter than a run header are kept inside the run rather than splitting it
+ */
+inline bool export_runs(const std::string& path, const std::vector<weight>& net) {
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) return false;
+	header head = { sparse_magic, version, uint32_t(net.size()), cap_of(net) };
+	out.write(reinterpret_cast<const char*>(&head), sizeof(head));
+
+	const size_t gap = (sizeof(uint64_t) + sizeof(uint32_t)) / sizeof(weight::type);
+	std::vector<weight::type> block(weight::page_size), run;
+	size_t zeros = 0; // zeros since the last non-zero entry of the current run, not yet appended
+	auto flush = [&](uint64_t offset) {
+		zeros = 0;
+		if (run.empty()) return;
+		uint32_t length = run.size();
+		out.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+		out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		out.write(reinterpret_cast<const char*>(run.data()), sizeof(weight::type) * length);
+		run.clear();
+	};
+	for (const weight& w : net) {
+		uint64_t size = w.size(), order = w.remapping().size();
+		out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		out.write(reinterpret_cast<const char*>(&order), sizeof(order));
+		out.write(reinterpret_cast<const char*>(w.remapping().data()), sizeof(uint32_t) * order);
+
+		uint64_t begin = 0; // slot of run[0]
+		zeros = 0;
+		for (size_t i = 0; i < size; i += block.size()) {
+			size_t len = std::min<size_t>(block.size(), size - i);
+			w.export_range(i, len, block.data());
+			for (size_t k = 0; k < len; k++) {
+				if (block[k] == 0) {
+					zeros += run.size() ? 1 : 0;
+					continue;
+				}
+				if (zeros > gap || run.size() + zeros >= (size_t(1) << 31)) flush(begin);
+				if (run.empty()) begin = i + k;
+				else run.insert(run.end(), zeros, weight::type(0));
+				run.push_back(block[k]);
+				zeros = 0;
+			}
+		}
+		flush(begin);
+		uint64_t end = 0;
+		uint32_t none = 0;
+		out.write(reinterpret_cast<const char*>(&end), sizeof(end));
+		out.write(reinterpret_cast<const char*>(&none), sizeof(none));
+	}
+	return bool(out);
+}
+
+/**
+ * load a sparse export, the tables are rebuilt dense, or paged if 'paged_bytes' is given
+ */
+inline bool import_runs(const std::string& path, std::vector<weight>& net, size_t paged_bytes = 0) {
+	std::ifstream in(path, std::ios::in | std::ios::binary);
+	header head;
+	if (!in.read(reinterpret_cast<char*>(&head), sizeof(head)) || head.magic != sparse_magic || head.version != version)
+		return false;
+	net.clear();
+	net.resize(head.count);
+	std::vector<weight::type> run;
+	for (weight& w : net) {
+		uint64_t size = 0, order = 0;
+		in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		in.read(reinterpret_cast<char*>(&order), sizeof(order));
+		if (paged_bytes) w.page(size, paged_bytes);
+		else w.reset(size);
+		std::vector<uint32_t> slots(order);
+		in.read(reinterpret_cast<char*>(slots.data()), sizeof(uint32_t) * order);
+		if (!w.remap(slots, false)) return false;
+		for (uint64_t offset; in.read(reinterpret_cast<char*>(&offset), sizeof(offset)); ) {
+			uint32_t length = 0;
+			in.read(reinterpret_cast<char*>(&length), sizeof(length));
+			if (length == 0) break;
+			if (offset + length > size) return false;
+			run.resize(length);
+			in.read(reinterpret_cast<char*>(run.data()), sizeof(weight::type) * length);
+			w.import_range(offset, length, run.data());
+		}
+	}
+	set_cap(net, head.flags & 0xff);
+	return bool(in);
+}
+
+/**
+ * whether a table holds exactly the given entries (in slot order)
+ */
+inline bool equal(const weight& w, const weight::type* data) {
+	if (!w.is_paged()) return std::memcmp(w.data(), data, sizeof(weight::type) * w.size()) == 0;
+	std::vector<weight::type> block(weight::page_size);
+	for (size_t i = 0; i < w.size(); i += block.size()) {
+		size_t len = std::min<size_t>(block.size(), w.size() - i);
+		w.export_range(i, len, block.data());
+		if (std::memcmp(block.data(), data + i, sizeof(weight::type) * len) != 0) return false;
+	}
+	return true;
+}
+
+/**
+ * refresh the tables from a checkpoint of the same layout, replacing only the tables that changed
+ *
+ * the file is mapped rather than read, so the unchanged tables cost a comparison against the page cache
+ * a changed table is rebuilt aside and then moved in, keeping whether it is paged
+ * return the number of tables replaced, or -1 if the file is not a checkpoint of the same layout
+ */
+inline int refresh(const std::string& path, std::vector<weight>& net) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return -1;
+	struct stat st;
+	if (::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(header)) {
+		::close(fd);
+		return -1;
+	}
+	void* map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) return -1;
+	const char* base = static_cast<const char*>(map);
+
+	int replaced = -1;
+	const header& head = *reinterpret_cast<const header*>(base);
+	const entry* index = reinterpret_cast<const entry*>(base + sizeof(header));
+	bool same = head.magic == magic && head.version == version && head.count == net.size() && (head.flags & 0xff) == cap_of(net)
+		&& within(sizeof(header), head.count, sizeof(entry), st.st_size);
+	for (size_t t = 0; same && t < net.size(); t++) {
+		same = index[t].size == net[t].size() && index[t].order_size == net[t].remapping().size()
+			&& within(index[t].offset, index[t].size, sizeof(weight::type), st.st_size)
+			&& within(index[t].order_offset, index[t].order_size, sizeof(uint32_t), st.st_size);
+		same = same && std::equal(net[t].remapping().begin(), net[t].remapping().end(),
+			reinterpret_cast<const uint32_t*>(base + index[t].order_offset));
+	}
+	if (same) {
+		replaced = 0;
+		for (size_t t = 0; t < net.size(); t++) {
+			const weight::type* data = reinterpret_cast<const weight::type*>(base + index[t].offset);
+			if (equal(net[t], data)) continue;
+			weight next = net[t].is_paged() ? weight::paged(index[t].size, net[t].budget_bytes()) : weight(index[t].size);
+			next.import_range(0, index[t].size, data);
+			next.remap(net[t].remapping(), false);
+			next.cap(net[t].cap());
+			net[t] = std::move(next);
+			replaced++;
+		}
+	}
+	::munmap(map, st.st_size);
+	return replaced;
+}
+
+/**
+ * the legacy stream format: the number of tables (uint32), then each table by weight::operator<<
+ *
+ * the index remappings follow the tables as an optional trailer
+ * "RMAP", then for each table, the length (0 for identity) and the hot list as uint32
+ * the tables themselves are stored in slot order
+ * the tile cap of the indices follows as another optional trailer, "TCAP" then the cap as uint32
+ */
+static constexpr uint32_t remapping_magic = 0x50414d52; // "RMAP"
+static constexpr uint32_t cap_magic = 0x50414354; // "TCAP"
+
+inline bool load_stream(const std::string& path, std::vector<weight>& net, size_t paged_bytes = 0) {
+	std::ifstream in(path, std::ios::in | std::ios::binary | std::ios::ate);
+	if (!in.is_open()) return false;
+	uint64_t length = in.tellg();
+	in.seekg(0);
+	uint32_t size = 0;
+	in.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if (!in || sizeof(uint64_t) * size > length) return false;
+	net.clear();
+	net.resize(size);
+	for (weight& w : net) { // check the size of each table against the rest of the file before allocating it
+		uint64_t len = 0;
+		std::streampos at = in.tellg();
+		if (!in.read(reinterpret_cast<char*>(&len), sizeof(len)) || sizeof(weight::type) * len > length - in.tellg()) return false;
+		in.seekg(at);
+		if (paged_bytes) w.page(0, paged_bytes);
+		if (!(in >> w)) return false;
+	}
+	for (uint32_t trailer; in.read(reinterpret_cast<char*>(&trailer), sizeof(trailer)); ) {
+		if (trailer == remapping_magic) {
+			for (weight& w : net) {
+				uint64_t len = 0;
+				if (!in.read(reinterpret_cast<char*>(&len), sizeof(len)) || len > w.size()) return false;
+				std::vector<uint32_t> order(len);
+				in.read(reinterpret_cast<char*>(order.data()), sizeof(uint32_t) * len);
+				if (!w.remap(order, false)) return false;
+			}
+		} else if (trailer == cap_magic) {
+			uint32_t cap = 0;
+			in.read(reinterpret_cast<char*>(&cap), sizeof(cap));
+			set_cap(net, cap & 0xff);
+		} else {
+			break;
+		}
+	}
+	return true;
+}
+
+inline bool save_stream(const std::string& path, const std::vector<weight>& net) {
+	std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) return false;
+	uint32_t size = net.size();
+	out.write(reinterpret_cast<char*>(&size), sizeof(size));
+	for (const weight& w : net) out << w;
+	bool remapped = false;
+	for (const weight& w : net) remapped |= !w.remapping().empty();
+	if (remapped) {
+		uint32_t trailer = remapping_magic;
+		out.write(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+		for (const weight& w : net) {
+			uint64_t len = w.remapping().size();
+			out.write(reinterpret_cast<char*>(&len), sizeof(len));
+			out.write(reinterpret_cast<const char*>(w.remapping().data()), sizeof(uint32_t) * len);
+		}
+	}
+	if (cap_of(net)) {
+		uint32_t trailer = cap_magic, cap = cap_of(net);
+		out.write(reinterpret_cast<char*>(&trailer), sizeof(trailer));
+		out.write(reinterpret_cast<char*>(&cap), sizeof(cap));
+	}
+	return bool(out);
+}
+
+/**
+ * load the tables in any of the formats above, detected by the magic
+ */
+inline bool load_any(const std::string& path, std::vector<weight>& net, unsigned threads, bool direct = false, size_t paged_bytes = 0) {
+	if (detect(path)) return load(path, net, threads, direct, paged_bytes);
+	if (detect(path, sparse_magic)) return import_runs(path, net, paged_bytes);
+	return load_stream(path, net, paged_bytes);
+}
+
+} // namespace checkpoint
@@ -15,29 +15,46 @@
 #include <sstream>
 #include <chrono>
 #include <numeric>
+#include <cstdint>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
 
 class episode {
 public:
-	episode() : ep_state(initial_state()), ep_score(0), ep_time(0) { ep_moves.reserve(10000); }
+	episode() : ep_state(initial_state()), ep_start(ep_state.pack()), ep_score(0), ep_time(0) { ep_moves.reserve(10000); }
 
 public:
 	board& state() { return ep_state; }
 	const board& state() const { return ep_state; }
 	board::score score() const { return ep_score; }
 
+	/**
+	 * the state before the first move, which is empty unless given by start_from
+	 */
+	board start() const { return board(ep_start); }
+
+	/**
+	 * start the episode from a given state instead of the empty board
+	 * should be called before any move is applied
+	 */
+	void start_from(const board& b) {
+		ep_state = b;
+		ep_start = b.pack();
+	}
+
 	void open_episode(const std::string& tag) {
 		ep_open = { tag, millisec() };
 	}
 	void close_episode(const std::string& tag) {
 		ep_close = { tag, millisec() };
+		ep_moves.shrink_to_fit();
+		ep_times.shrink_to_fit();
 	}
 	bool apply_action(action move) {
 		board::reward reward = move.apply(state());
 		if (reward == -1) return false;
-		ep_moves.emplace_back(move, reward, millisec() - ep_time);
+		record(move, millisec() - ep_time);
 		ep_score += reward;
 		return true;
 	}
@@ -61,13 +78,11 @@ public:
 
 	time_t time(unsigned who = -1u) const {
 		time_t time = 0;
-		size_t i = 2;
 		switch (who) {
 		case action::place::type:
-			if (ep_moves.size()) time += ep_moves[0].time, i = 1;
-			// no break;
 		case action::slide::type:
-			while (i < ep_moves.size()) time += ep_moves[i].time, i += 2;
+			for (const timing& t : ep_times)
+				if (turn(t.index) == who) time += t.time;
 			break;
 		default:
 			time = ep_close.when - ep_open.when;
@@ -81,13 +96,13 @@ public:
 		size_t i = 2;
 		switch (who) {
 		case action::place::type:
-			if (ep_moves.size()) res.push_back(ep_moves[0]), i = 1;
+			if (ep_moves.size()) res.push_back(decode(ep_moves[0])), i = 1;
 			// no break;
 		case action::slide::type:
-			while (i < ep_moves.size()) res.push_back(ep_moves[i]), i += 2;
+			while (i < ep_moves.size()) res.push_back(decode(ep_moves[i])), i += 2;
 			break;
 		default:
-			res.assign(ep_moves.begin(), ep_moves.end());
+			for (packed code : ep_moves) res.push_back(decode(code));
 			break;
 		}
 		return res;
@@ -97,7 +112,13 @@ public:
 
 	friend std::ostream& operator <<(std::ostream& out, const episode& ep) {
 		out << ep.ep_open << '|';
-		for (const move& mv : ep.ep_moves) out << mv;
+		if (ep.ep_start != initial_state().pack()) {
+			board start = ep.start();
+			out << '{';
+			for (board::cell t : start) out << tiles()[std::min(t, 32u)];
+			out << '}';
+		}
+		for (const move& mv : ep.moves()) out << mv;
 		out << '|' << ep.ep_close;
 		return out;
 	}
@@ -107,13 +128,26 @@ public:
 		std::getline(in, token, '|');
 		std::stringstream(token) >> ep.ep_open;
 		std::getline(in, token, '|');
+		if (token.size() && token[0] == '{') {
+			for (size_t i = 0; i < board::cells && i + 1 < token.size(); i++) {
+				const char* idx = tiles();
+				ep.ep_state(i) = std::find(idx, idx + 32, token[i + 1]) - idx;
+			}
+			ep.ep_start = ep.ep_state.pack();
+			token.erase(0, token.find('}') + 1);
+		}
 		for (std::stringstream moves(token); !moves.eof(); moves.peek()) {
-			ep.ep_moves.emplace_back();
-			moves >> ep.ep_moves.back();
-			ep.ep_score += action(ep.ep_moves.back()).apply(ep.ep_state);
+			move mv;
+			moves >> mv;
+			board::reward reward = mv.code.apply(ep.ep_state);
+			if (reward == -1) continue;
+			ep.ep_score += reward;
+			ep.record(mv.code, mv.time);
 		}
 		std::getline(in, token, '|');
 		std::stringstream(token) >> ep.ep_close;
+		ep.ep_moves.shrink_to_fit();
+		ep.ep_times.shrink_to_fit();
 		return in;
 	}
 
@@ -150,6 +184,40 @@ protected:
 		}
 	};
 
+	/**
+	 * one-byte move encoding, only legal (applied) actions are recorded
+	 * placing: 0b000tpppp, where t is (tile - 1) and p is the position
+	 * sliding: 0b001000oo, where o is the opcode
+	 */
+	typedef uint8_t packed;
+
+	static packed encode(const action& a) {
+		if (a.type() == action::slide::type) return 0x20 | (a.event() & 0b11);
+		action::place pl(a);
+		return ((pl.tile() - 1) << 4) | pl.position();
+	}
+	static action decode(packed code) {
+		if (code & 0x20) return action::slide(code & 0b11);
+		return action::place(code & 0x0f, (code >> 4) + 1);
+	}
+
+	/**
+	 * the thinking time of a move, only non-zero times are recorded
+	 */
+	struct timing {
+		uint32_t index;
+		uint32_t time;
+	};
+
+	static unsigned turn(size_t index) {
+		return index < 2 || index % 2 ? action::place::type : action::slide::type;
+	}
+
+	void record(const action& move, time_t time) {
+		if (time) ep_times.push_back({ uint32_t(ep_moves.size()), uint32_t(time) });
+		ep_moves.push_back(encode(move));
+	}
+
 	struct meta {
 		std::string tag;
 		time_t when;
@@ -163,6 +231,32 @@ protected:
 		}
 	};
 
+	/**
+	 * decode the full move records, i.e., action, reward, and time
+	 * rewards are not stored and are recomputed by replaying from the initial state
+	 */
+	std::vector<move> moves() const {
+		std::vector<move> res;
+		res.reserve(ep_moves.size());
+		board replay = start();
+		auto tm = ep_times.begin();
+		for (size_t i = 0; i < ep_moves.size(); i++) {
+			action code = decode(ep_moves[i]);
+			board::reward reward = code.apply(replay);
+			time_t time = 0;
+			if (tm != ep_times.end() && tm->index == i) time = (tm++)->time;
+			res.emplace_back(code, reward, time);
+		}
+		return res;
+	}
+
+	/**
+	 * the characters of tiles (index value) for writing a start state, e.g., 'D' is 8192
+	 */
+	static const char* tiles() {
+		return "0123456789ABCDEFGHIJKLMNOPQRSTUV?";
+	}
+
 	static board initial_state() {
 		return {};
 	}
@@ -173,8 +267,10 @@ protected:
 
 private:
 	board ep_state;
+	board::packed ep_start;
 	board::score ep_score;
-	std::vector<move> ep_moves;
+	std::vector<packed> ep_moves;
+	std::vector<timing> ep_times;
 	time_t ep_time;
 
 	meta ep_open;
@@ -0,0 +1,132 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * evaluator.h: Background evaluation of weight snapshots by greedy play
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "board.h"
+#include "weight.h"
+#include "ntuple.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+/**
+ * evaluator running on its own thread
+ *
+ * whenever a newer snapshot is published, the evaluator pins it and plays 'games' greedy games,
+ * i.e., always the slide maximizing the reward plus the afterstate value adjusted by the strategy
+ * of the trained slider, without learning; thus the results are the strength of its one-ply policy
+ * the games are interleaved by a scheduler of the given 'width' (see scheduler)
+ * the result is posted to the metrics registry under 'key', thus printed with the block reports
+ *
+ * 'share' bounds the CPU time taken by the evaluator: after each batch of 'width' games, it sleeps for
+ * the time of the batch scaled by (1 - share) / share
+ * when stopped, the evaluator finishes the snapshot in progress
+ */
+class evaluator {
+public:
+	evaluator(const ntuple& features, const strategy& rule, const rcu<std::vector<weight>>& source, size_t games,
+			double share = 0.25, size_t period = 1, unsigned seed = 0, size_t width = 1, const std::string& key = "评估")
+		: source(source), games(std::max<size_t>(games, 1)),
+		  share(std::min(std::max(share, 0.01), 1.0)), period(period), width(std::max<size_t>(width, 1)), key(key),
+		  play(features, width, seed, rule), running(true), evaluated(0) {
+		worker = std::thread(&evaluator::run, this);
+	}
+	~evaluator() { stop(); }
+
+	/**
+	 * stop after the snapshot in progress
+	 */
+	void stop() {
+		if (!worker.joinable()) return;
+		running.store(false, std::memory_order_release);
+		worker.join();
+	}
+
+	size_t count() const { return evaluated.load(); }
+
+	/**
+	 * the latest report line, empty if nothing has been evaluated
+	 */
+	std::string report() const {
+		for (const auto& line : metrics::global().lines())
+			if (line.first == key) return line.second;
+		return {};
+	}
+
+private:
+	typedef scheduler::result result;
+
+	void run() {
+		uint64_t done = 0;
+		while (true) {
+			uint64_t version = source.version();
+			if (version == done) {
+				if (!running.load(std::memory_order_acquire)) break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+			rcu<std::vector<weight>>::pointer net = source.pin();
+			std::vector<result> res;
+			for (size_t i = 0; i < games; i += width) {
+				auto begin = std::chrono::steady_clock::now();
+				for (const result& r : play.play(*net, std::min(width, games - i), i)) res.push_back(r);
+				auto spent = std::chrono::steady_clock::now() - begin;
+				if (share < 1 && running.load(std::memory_order_acquire))
+					std::this_thread::sleep_for(spent * ((1 - share) / share));
+			}
+			net.reset(); // release the snapshot
+			done = version;
+			evaluated++;
+			post(version, res);
+		}
+	}
+
+	/**
+	 * e.g., "[评估] 快照#3 (训练3000局) 20局: 平均分=12345 最高分=34567 2048=45.0% 胜利=0.0%"
+	 */
+	void post(uint64_t version, const std::vector<result>& res) {
+		board::score sum = 0, max = 0;
+		size_t reach = 0, win = 0;
+		for (const result& r : res) {
+			sum += r.score;
+			max = std::max(max, r.score);
+			reach += (r.tile >= 11); // 2048-tiles
+			win += r.win;
+		}
+		std::stringstream line;
+		line << std::fixed << std::setprecision(1);
+		line << "[" << key << "] 快照#" << version;
+		if (period) line << " (训练" << (version * period) << "局)";
+		line << " " << res.size() << "局: 平均分=" << (sum / res.size()) << " 最高分=" << max;
+		line << " 2048=" << (reach * 100.0 / res.size()) << "%";
+		line << " 胜利=" << (win * 100.0 / res.size()) << "%";
+		metrics::global().post(key, line.str());
+	}
+
+private:
+	const rcu<std::vector<weight>>& source;
+	size_t games;
+	double share;
+	size_t period;
+	size_t width;
+	std::string key;
+	scheduler play;
+
+	std::thread worker;
+	std::atomic<bool> running;
+	std::atomic<size_t> evaluated;
+};
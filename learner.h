@@ -0,0 +1,276 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * learner.h: Asynchronous TD learner fed by actors through a lock-free trajectory queue
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cmath>
+#include "weight.h"
+#include "ntuple.h"
+#include "snapshot.h"
+
+/**
+ * bounded single-producer single-consumer lock-free queue
+ */
+template<class type>
+class spsc_queue {
+public:
+	spsc_queue(size_t capacity) : ring(capacity + 1), head(0), tail(0) {}
+
+	bool push(const type& v) {
+		size_t t = tail.load(std::memory_order_relaxed), next = (t + 1) % ring.size();
+		if (next == head.load(std::memory_order_acquire)) return false;
+		ring[t] = v;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+	bool pop(type& v) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		v = ring[h];
+		head.store((h + 1) % ring.size(), std::memory_order_release);
+		return true;
+	}
+	size_t size() const {
+		size_t h = head.load(std::memory_order_acquire), t = tail.load(std::memory_order_acquire);
+		return (t + ring.size() - h) % ring.size();
+	}
+	size_t capacity() const { return ring.size() - 1; }
+
+private:
+	std::vector<type> ring;
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+};
+
+/**
+ * an episode in feature indices, i.e., what the learner needs without the boards
+ * step t keeps the indices of all features of its state, its reward, and its value at play time
+ */
+struct trajectory {
+	size_t width;                 // number of features per step
+	std::vector<uint32_t> index;  // step t at [t * width, (t + 1) * width)
+	std::vector<float> reward;
+	std::vector<float> evaluation;
+	float final_reward;
+
+	trajectory(size_t width = 0) : width(width), final_reward(0) {}
+	size_t size() const { return reward.size(); }
+	const uint32_t* step(size_t t) const { return index.data() + t * width; }
+};
+
+/**
+ * TD learner running on its own thread
+ *
+ * the learner owns the master weights and applies the trajectories pushed by the actor
+ * the actor plays on a snapshot published by the learner (see rcu), which it pins rather than copies, and which
+ * is refreshed every 'sync' trajectories; the initial snapshot is published before the thread starts,
+ * and other readers (e.g., an evaluator) may pin the snapshots as well
+ * the actor blocks when 'stale' trajectories are still pending,
+ * which bounds how far the weights used for playing lag behind the master weights
+ *
+ * the updates follow strategic_slider: the per-step TD(0) updates in play order,
+ * then the backward update of the final reward, each touching the listed isomorphisms
+ * with a non-zero 'batch', the updates of 'batch' trajectories are accumulated and applied
+ * together in address order (see weight_batch), and the TD errors use the weights before the batch
+ */
+class td_learner {
+public:
+	typedef std::vector<std::pair<unsigned, float>> update_rule; // (isomorphism, step scale)
+
+	td_learner(const std::vector<weight>& net, const update_rule& rule,
+			float alpha, float lambda, size_t stale, size_t sync, size_t batch = 0)
+		: master(net), rule(rule), alpha(alpha), lambda(lambda), sync(std::max<size_t>(sync, 1)), batch(batch),
+		  queue(std::max<size_t>(stale, 1)), running(true), seen(0),
+		  pushed(0), applied(0), depth_sum(0), depth_max(0), blocked(0), busy(0) {
+		publish();
+		worker = std::thread(&td_learner::run, this);
+	}
+	~td_learner() { stop(); }
+
+public:
+	/**
+	 * push a trajectory, blocking while the staleness bound is reached
+	 */
+	void push(trajectory* t) {
+		size_t depth = queue.size();
+		depth_sum += depth;
+		depth_max = std::max(depth_max, depth);
+		auto begin = std::chrono::steady_clock::now();
+		bool wait = false;
+		while (!queue.push(t)) {
+			wait = true;
+			std::this_thread::yield();
+		}
+		if (wait) blocked += elapsed(begin);
+		pushed++;
+	}
+
+	/**
+	 * pin the latest published snapshot in 'held', if there is a newer one (or nothing is held yet)
+	 */
+	bool fetch(rcu<std::vector<weight>>::pointer& held) {
+		uint64_t latest = published.version();
+		if (held && latest == seen) return false;
+		held = published.pin();
+		seen = latest;
+		return true;
+	}
+
+	/**
+	 * the published snapshots, which concurrent readers may pin
+	 */
+	const rcu<std::vector<weight>>& snapshots() const { return published; }
+
+	/**
+	 * call 'visit' with the master weights once all pushed trajectories (and a pending batch) are applied,
+	 * while the thread waits; called by the actor, e.g., for saving the master weights in the middle of training
+	 */
+	template<class visitor>
+	void inspect(visitor visit) {
+		if (!worker.joinable()) {
+			visit(static_cast<const std::vector<weight>&>(master));
+			return;
+		}
+		std::unique_lock<std::mutex> lock(gate);
+		wanted = true;
+		turn.wait(lock, [&]() { return paused; });
+		visit(static_cast<const std::vector<weight>&>(master));
+		wanted = false;
+		turn.notify_all();
+	}
+
+	/**
+	 * apply all pending trajectories, stop the thread, and return the master weights
+	 */
+	std::vector<weight>& stop() {
+		if (worker.joinable()) {
+			running.store(false, std::memory_order_release);
+			worker.join();
+		}
+		return master;
+	}
+
+public:
+	size_t pending() const { return queue.size(); }
+	size_t capacity() const { return queue.capacity(); }
+	size_t count() const { return applied.load(); }
+	double mean_depth() const { return pushed ? double(depth_sum) / pushed : 0; }
+	size_t max_depth() const { return depth_max; }
+	double blocked_time() const { return blocked; } // milliseconds the actor waited
+	double busy_time() const { return busy.load() / 1000.0; } // milliseconds the learner worked
+
+private:
+	void run() {
+		for (trajectory* t; ; ) {
+			if (!queue.pop(t)) {
+				if (!running.load(std::memory_order_acquire) && queue.size() == 0) {
+					updates.apply(master);
+					break;
+				}
+				std::unique_lock<std::mutex> lock(gate);
+				if (wanted && queue.size() == 0) { // hand the master weights to inspect()
+					updates.apply(master);
+					paused = true;
+					turn.notify_all();
+					turn.wait(lock, [&]() { return !wanted; });
+					paused = false;
+					continue;
+				}
+				lock.unlock();
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				continue;
+			}
+			auto begin = std::chrono::steady_clock::now();
+			learn(*t);
+			delete t;
+			if (batch && (applied + 1) % batch == 0) updates.apply(master);
+			if (++applied % sync == 0) publish();
+			busy += uint64_t(elapsed(begin) * 1000);
+		}
+	}
+
+	void learn(const trajectory& t) {
+		size_t n = t.size();
+		if (n == 0) return;
+		for (size_t i = 1; i < n; i++) {
+			float target = t.reward[i - 1] + lambda * estimate(t.step(i), t.width);
+			update(t.step(i - 1), t.width, target - t.evaluation[i - 1]);
+		}
+		float error = t.final_reward - t.evaluation[n - 1];
+		for (size_t i = n; i-- > 0; ) {
+			update(t.step(i), t.width, error * std::pow(lambda, n - 1 - i));
+			if (i > 0) error = t.reward[i] + lambda * error;
+		}
+	}
+
+	float estimate(const uint32_t* index, size_t width) const {
+		float value = 0;
+		for (size_t f = 0; f < width; f++) value += ntuple::lookup(master, f, index[f]);
+		return value;
+	}
+
+	void update(const uint32_t* index, size_t width, float error) {
+		for (size_t f = 0; f < width; f += ntuple::isomorphisms) {
+			weight& w = master[f / ntuple::isomorphisms];
+			for (const auto& iso : rule) {
+				uint32_t i = index[f + iso.first];
+				if (i >= w.size()) continue;
+				if (batch) updates.add(f / ntuple::isomorphisms, i, alpha * error * iso.second);
+				else w[i] += alpha * error * iso.second;
+			}
+		}
+	}
+
+	/**
+	 * publish a copy of all tables, whose cost grows with the size of the network rather than with
+	 * the entries touched since the last publication; a larger 'sync' spreads it over more trajectories
+	 */
+	void publish() {
+		size_t bytes = 0;
+		for (const weight& w : master) bytes += w.copy_bytes();
+		published.publish(master, bytes);
+	}
+
+	static double elapsed(std::chrono::steady_clock::time_point begin) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+private:
+	std::vector<weight> master;
+	rcu<std::vector<weight>> published;
+	update_rule rule;
+	float alpha;
+	float lambda;
+	size_t sync;
+	size_t batch;
+	weight_batch updates;
+
+	spsc_queue<trajectory*> queue;
+	std::thread worker;
+	std::atomic<bool> running;
+	uint64_t seen; // the version fetched by the actor
+	std::mutex gate; // inspect() waits for the thread to pause between trajectories
+	std::condition_variable turn;
+	bool wanted = false;
+	bool paused = false;
+
+	size_t pushed;
+	std::atomic<size_t> applied;
+	size_t depth_sum;
+	size_t depth_max;
+	double blocked;
+	std::atomic<uint64_t> busy; // microseconds
+};
@@ -0,0 +1,181 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * lib2048.cpp: Implementation of the C interface of lib2048.so
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <fstream>
+#include "lib2048.h"
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "network.h"
+#include "checkpoint.h"
+
+namespace {
+
+/**
+ * the slider of a network, which neither writes game records nor exits on failure
+ * 'save=' and 'export=' are done here rather than by the base, whose failure would exit the host
+ */
+class library_slider : public strategic_slider {
+public:
+	library_slider(const std::string& args) : strategic_slider(args + " record=0") {}
+	~library_slider() {
+		try {
+			if (meta.find("save") != meta.end()) save(meta["save"], io_threads);
+			if (meta.find("export") != meta.end())
+				visit_master([&](const std::vector<weight>& w) { checkpoint::export_runs(meta["export"], w); });
+		} catch (...) {}
+		meta.erase("save");
+		meta.erase("export");
+	}
+
+	/**
+	 * save the master weights, i.e., those of the learner thread with asynchronous learning
+	 */
+	bool save(const std::string& path, int threads) {
+		bool saved = false;
+		visit_master([&](const std::vector<weight>& w) { saved = write_weights(path, w, std::max(threads, 0)); });
+		return saved;
+	}
+};
+
+board unpack(const t2048_board& b) { return board(board::packed{ b.nibble, b.high }); }
+t2048_board pack(const board& b) { board::packed p = b.pack(); return { p.nibble, p.high }; }
+
+/**
+ * suppress the output of std::cout within a scope
+ */
+struct quiet {
+	std::streambuf* saved;
+	std::ofstream null;
+	quiet() : saved(std::cout.rdbuf()), null("/dev/null") { std::cout.rdbuf(null.rdbuf()); }
+	~quiet() { std::cout.rdbuf(saved); }
+};
+
+} // namespace
+
+struct t2048_network {
+	std::unique_ptr<library_slider> slider;
+	std::unique_ptr<network> view; // read-only view of the slider's weights for batched evaluation
+	std::vector<board> boards;
+
+	void refresh() {
+		view.reset(new network(slider->get_features(), slider->get_strategy()));
+		view->assign(slider->get_weights());
+	}
+};
+
+extern "C" {
+
+int t2048_abi_version(void) {
+	return T2048_ABI_VERSION;
+}
+
+void t2048_slide(const t2048_board* in, const int32_t* op, size_t n, t2048_board* out, int32_t* reward) {
+	for (size_t i = 0; i < n; i++) {
+		board b = unpack(in[i]);
+		reward[i] = (op[i] >= 0 && op[i] < 4) ? b.slide(op[i]) : -1;
+		out[i] = pack(b);
+	}
+}
+
+void t2048_place(const t2048_board* in, const int32_t* pos, const int32_t* tile, size_t n, t2048_board* out, int32_t* reward) {
+	for (size_t i = 0; i < n; i++) {
+		board b = unpack(in[i]);
+		bool legal = pos[i] >= 0 && pos[i] < int(board::cells) && tile[i] > 0 && tile[i] < 32;
+		reward[i] = legal ? b.place(pos[i], tile[i]) : -1;
+		out[i] = pack(b);
+	}
+}
+
+t2048_network* t2048_create(const char* args) {
+	try {
+		std::string text = args ? args : "";
+		quiet mute;
+		std::unique_ptr<t2048_network> net(new t2048_network);
+		net->slider.reset(new library_slider(text));
+		net->refresh();
+		return net.release();
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void t2048_free(t2048_network* net) {
+	if (!net) return;
+	quiet mute;
+	delete net;
+}
+
+int t2048_save(t2048_network* net, const char* path, int threads) {
+	if (!net || !path) return -1;
+	try {
+		return net->slider->save(path, threads) ? 0 : -1;
+	} catch (...) {
+		return -1;
+	}
+}
+
+void t2048_evaluate(t2048_network* net, const t2048_board* after, size_t n, float* value) {
+	net->boards.resize(n);
+	for (size_t i = 0; i < n; i++) net->boards[i] = unpack(after[i]);
+	net->view->estimate(net->boards.data(), n, value);
+}
+
+void t2048_choose(t2048_network* net, const t2048_board* state, size_t n, int32_t* move, float* value) {
+	net->boards.resize(n);
+	for (size_t i = 0; i < n; i++) net->boards[i] = unpack(state[i]);
+	std::vector<int> moves(n);
+	net->view->choose(net->boards.data(), n, moves.data(), value);
+	for (size_t i = 0; i < n; i++) move[i] = moves[i];
+}
+
+int t2048_selfplay(t2048_network* net, uint64_t games, uint32_t seed, t2048_result* result) {
+	if (!net) return -1;
+	try {
+		quiet mute;
+		t2048_result res = {};
+		random_placer place("seed=" + std::to_string(seed));
+		agent& slide = *net->slider;
+		for (uint64_t g = 0; g < games; g++) {
+			slide.open_episode("~:" + place.name());
+			place.open_episode(slide.name() + ":~");
+			episode game;
+			game.open_episode(slide.name() + ":" + place.name());
+			while (true) {
+				agent& who = game.take_turns(slide, place);
+				action move = who.take_action(game.state());
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+			}
+			agent& win = game.last_turns(slide, place);
+			game.close_episode(win.name());
+			slide.close_episode(win.name());
+			place.close_episode(win.name());
+
+			res.games++;
+			res.steps += game.step(action::slide::type);
+			res.mean_score += game.score();
+			res.max_score = std::max<uint64_t>(res.max_score, game.score());
+			res.tiles[game.state().max_tile_value() & 31]++;
+		}
+		if (res.games) res.mean_score /= res.games;
+		net->refresh(); // the tables may have been rearranged, e.g., by remapping
+		if (result) *result = res;
+		return 0;
+	} catch (...) {
+		return -1;
+	}
+}
+
+} // extern "C"
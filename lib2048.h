@@ -0,0 +1,103 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * lib2048.h: C interface of lib2048.so, i.e., board operations, evaluation, and self-play
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#ifndef LIB2048_H
+#define LIB2048_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define T2048_ABI_VERSION 1
+
+/* the library is built with hidden visibility, only the functions below are exported */
+#if defined(__GNUC__)
+#define T2048_API __attribute__((visibility("default")))
+#else
+#define T2048_API
+#endif
+
+/**
+ * packed board of the standard 4x4 game, in the same layout as board::packed
+ * cell i holds tile ((nibble >> 4i) & 15) | (((high >> i) & 1) << 4), where tile t is the value 2^t (0 for empty)
+ */
+typedef struct t2048_board {
+	uint64_t nibble;
+	uint16_t high;
+} t2048_board;
+
+/**
+ * summary of self-play games
+ */
+typedef struct t2048_result {
+	uint64_t games;
+	uint64_t steps;     /* slides played */
+	double mean_score;
+	uint64_t max_score;
+	uint64_t tiles[32]; /* games ending with tile t as the largest */
+} t2048_result;
+
+/**
+ * opaque network, i.e., an n-tuple network with its learning settings
+ * a network is not thread-safe; use one network per thread
+ */
+typedef struct t2048_network t2048_network;
+
+T2048_API int t2048_abi_version(void);
+
+/**
+ * board operations, on 'n' boards at once
+ * slide: op is 0 (up), 1 (right), 2 (down), or 3 (left); the reward is -1 for an illegal slide
+ * place: put tile t (1 for 2, 2 for 4) at cell pos; the reward is -1 if the cell is not empty
+ */
+T2048_API void t2048_slide(const t2048_board* in, const int32_t* op, size_t n, t2048_board* out, int32_t* reward);
+T2048_API void t2048_place(const t2048_board* in, const int32_t* pos, const int32_t* tile, size_t n, t2048_board* out, int32_t* reward);
+
+/**
+ * create a network from the arguments of the slider, e.g., "init=65536,65536,65536,65536 alpha=0.1"
+ * or "load=weights.bin tuple=0123,4567 cap=16"; return null on failure, e.g., if the weights cannot be loaded
+ * the library never exits the process; no game records are written, and 'save=' or 'export=' is done by t2048_free,
+ * whose failure is ignored (use t2048_save to check)
+ */
+T2048_API t2048_network* t2048_create(const char* args);
+T2048_API void t2048_free(t2048_network* net);
+
+/**
+ * save the weights, in the checkpoint format if 'threads' is positive, or in the stream format otherwise
+ * with asynchronous learning, these are the master weights once the pending games are learned
+ * return 0 on success
+ */
+T2048_API int t2048_save(t2048_network* net, const char* path, int threads);
+
+/**
+ * the values of 'n' afterstates
+ */
+T2048_API void t2048_evaluate(t2048_network* net, const t2048_board* after, size_t n, float* value);
+
+/**
+ * the moves of 'n' states by the policy of the slider in one ply, i.e., the slides maximizing reward plus afterstate value
+ * adjusted by its 'penalty' of danger and 'bonus' of empty cells (0 for both gives the greedy moves)
+ * the move is -1 if no slide is legal
+ */
+T2048_API void t2048_choose(t2048_network* net, const t2048_board* state, size_t n, int32_t* move, float* value);
+
+/**
+ * play 'games' games by the slider against the random placer, learning if the network was created with learning enabled
+ * the output of the slider is suppressed; return 0 on success
+ */
+T2048_API int t2048_selfplay(t2048_network* net, uint64_t games, uint32_t seed, t2048_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIB2048_H */
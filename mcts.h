@@ -0,0 +1,366 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * mcts.h: Monte Carlo tree search slider with chance nodes, pooled nodes, and tree reuse
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "ntuple.h"
+#include "metrics.h"
+
+/**
+ * node pool of a fixed capacity, addressed by 32-bit indices
+ * the storage is reserved once, so nodes never move; reset() discards all nodes in O(1)
+ * by rewinding the pool and advancing its generation, without touching the nodes
+ */
+template<typename node>
+class arena {
+public:
+	static constexpr uint32_t none = uint32_t(-1);
+
+	arena(size_t capacity = 0) : used(0), generation(0) { store.reserve(capacity); }
+
+	/**
+	 * a new node, or none if the pool is full
+	 */
+	uint32_t alloc() {
+		if (used == store.capacity()) return none;
+		if (used == store.size()) store.emplace_back();
+		store[used] = node();
+		return uint32_t(used++);
+	}
+	void reset() { used = 0; generation++; }
+
+	node& operator [](uint32_t i) { return store[i]; }
+	const node& operator [](uint32_t i) const { return store[i]; }
+	size_t size() const { return used; }
+	size_t capacity() const { return store.capacity(); }
+	size_t epoch() const { return generation; }
+
+private:
+	std::vector<node> store;
+	size_t used;
+	size_t generation;
+};
+
+/**
+ * Monte Carlo tree search slider, with decision nodes (states) and chance nodes (afterstates)
+ *
+ * a decision node selects its slide by UCB1 over reward plus the mean value of the afterstate,
+ * with the exploration scaled by the largest such value; a chance node samples a placement
+ * as the random placer does; a new decision node is evaluated by one ply of the n-tuple network,
+ * i.e., the best reward plus afterstate value; a state without legal slides is worth nothing, and
+ * a state reaching the win condition ends the game at the cost of 'win', as in the other searches
+ * (the exploration is scaled without such states, so that the penalty does not flatten it)
+ * the slide with the most visits is played
+ *
+ * the nodes come from two arenas; after the real slide and placement, the subtree of the
+ * reached state is copied into the spare arena, and the other arena is reset in O(1),
+ * thus the search continues on the kept statistics without freeing nodes one by one
+ *
+ * arguments: search=mcts n=1000 time=0 c=1 nodes=1048576 reuse=1 win=50000 seed=, and the network
+ * arguments of the weight agent, e.g., load= tuple= cap= (the cap recorded with the weights by default)
+ */
+class mcts_slider : public weight_agent {
+public:
+	mcts_slider(const std::string& args = "") : weight_agent("name=mcts role=slider " + args),
+		iterations(1000), limit(0), explore(1), reuse(true), penalty(50000), current(0), root(none), last(none) {
+		if (meta.find("n") != meta.end())
+			iterations = std::max<size_t>(size_t(meta["n"]), 1);
+		if (meta.find("time") != meta.end()) // milliseconds per move, instead of 'n' iterations
+			limit = double(meta["time"]) / 1000;
+		if (meta.find("c") != meta.end())
+			explore = float(meta["c"]);
+		if (meta.find("reuse") != meta.end())
+			reuse = int(meta["reuse"]);
+		if (meta.find("win") != meta.end())
+			penalty = float(meta["win"]);
+		if (meta.find("seed") != meta.end())
+			engine.seed(int(meta["seed"]));
+		features = adopt_features(); // throws if the weights do not fit
+		size_t capacity = meta.find("nodes") != meta.end() ? size_t(meta["nodes"]) : (size_t(1) << 20);
+		capacity = std::min(std::max<size_t>(capacity, 16), size_t(none));
+		pools[0] = tree(capacity);
+		pools[1] = tree(capacity);
+	}
+	virtual ~mcts_slider() {
+		metrics::global().erase("搜索");
+	}
+
+	virtual void open_episode(const std::string& flag = "") override {
+		weight_agent::open_episode(flag);
+		pools[current].reset();
+		root = last = none;
+		for (ntuple::state& leaf : leaves) leaf.reset(); // the weights may have been reloaded
+	}
+
+	virtual action take_action(const board& before) override {
+		typedef std::chrono::steady_clock clock;
+		auto begin = clock::now();
+		descend(before);
+		if (root == none) return action();
+
+		size_t start = nodes().size();
+		size_t count = 0;
+		if (limit > 0) {
+			while (std::chrono::duration<double>(clock::now() - begin).count() < limit) {
+				for (size_t i = 0; i < 16; i++) decide(root);
+				count += 16;
+			}
+		} else {
+			for (; count < iterations; count++) decide(root);
+		}
+
+		// play the most visited slide
+		uint32_t best = none;
+		for (uint32_t c = nodes()[root].child; c != none; c = nodes()[c].sibling) {
+			if (best == none || nodes()[c].visits > nodes()[best].visits ||
+				(nodes()[c].visits == nodes()[best].visits && nodes()[c].reward + nodes()[c].value > nodes()[best].reward + nodes()[best].value))
+				best = c;
+		}
+		last = best;
+
+		stat.moves++;
+		stat.iterations += count;
+		stat.created += nodes().size() - start;
+		stat.time += std::chrono::duration<double>(clock::now() - begin).count();
+		stat.size = std::max(stat.size, nodes().size());
+		return best != none ? action::slide(nodes()[best].op) : action();
+	}
+
+	virtual bool check_for_win(const board& b) override {
+		return b.is_win();
+	}
+
+	virtual void close_episode(const std::string& flag = "") override {
+		post();
+		weight_agent::close_episode(flag);
+	}
+
+protected:
+	virtual std::string misfit(const std::vector<weight>& tables) const override {
+		return table_misfit(features, tables);
+	}
+
+private:
+	static constexpr uint32_t none = arena<int>::none;
+
+	struct node {
+		board state;      // the state of a decision node, or the afterstate of a chance node
+		uint32_t child;   // the first child
+		uint32_t sibling; // the next sibling
+		uint32_t visits;
+		float value;      // the mean value, i.e., the future rewards after the state or the afterstate
+		float reward;     // the reward of the slide, for chance nodes
+		uint8_t op;       // the slide of a chance node, or the placement (pos * 2 + tile - 1) of a decision node
+		bool expanded;
+		node() : child(none), sibling(none), visits(0), value(0), reward(0), op(0), expanded(false) {}
+	};
+	typedef arena<node> tree;
+
+	tree& nodes() { return pools[current]; }
+
+	/**
+	 * move the root to the given state, keeping the subtree reached by the last slide and placement
+	 */
+	void descend(const board& state) {
+		uint32_t next = none;
+		if (reuse && last != none) {
+			for (uint32_t d = nodes()[last].child; d != none; d = nodes()[d].sibling)
+				if (nodes()[d].state == state) next = d;
+		}
+		tree& spare = pools[current ^ 1];
+		spare.reset();
+		root = next != none ? copy(nodes(), next, spare) : none;
+		if (root != none) stat.reused += spare.size();
+		nodes().reset();
+		current ^= 1;
+		last = none;
+		if (root == none) {
+			root = nodes().alloc();
+			if (root != none) nodes()[root].state = state;
+		}
+	}
+
+	/**
+	 * copy a subtree into another arena, keeping the order of the children
+	 */
+	static uint32_t copy(tree& from, uint32_t i, tree& to) {
+		uint32_t j = to.alloc();
+		if (j == none) return none;
+		to[j] = from[i];
+		to[j].child = to[j].sibling = none;
+		uint32_t tail = none;
+		for (uint32_t c = from[i].child; c != none; c = from[c].sibling) {
+			uint32_t k = copy(from, c, to);
+			if (k == none) break;
+			if (tail == none) to[j].child = k;
+			else to[tail].sibling = k;
+			tail = k;
+		}
+		return j;
+	}
+
+	/**
+	 * one iteration below a decision node, return the value of its state
+	 */
+	float decide(uint32_t d) {
+		if (!nodes()[d].expanded) return expand(d);
+		if (nodes()[d].child == none) return nodes()[d].value; // terminal
+
+		// select the slide by UCB1
+		float scale = 1;
+		for (uint32_t c = nodes()[d].child; c != none; c = nodes()[c].sibling)
+			if (!nodes()[c].state.is_win()) scale = std::max(scale, std::abs(nodes()[c].reward + nodes()[c].value));
+		float log = std::log(float(nodes()[d].visits) + 1);
+		uint32_t best = none;
+		float score = -std::numeric_limits<float>::max();
+		for (uint32_t c = nodes()[d].child; c != none; c = nodes()[c].sibling) {
+			const node& n = nodes()[c];
+			float ucb = n.reward + n.value + explore * scale * std::sqrt(log / (n.visits + 1));
+			if (ucb > score) score = ucb, best = c;
+		}
+
+		float v = nodes()[best].reward + sample(best);
+		node& n = nodes()[d];
+		n.visits++;
+		n.value += (v - n.value) / n.visits;
+		return v;
+	}
+
+	/**
+	 * create the afterstates of a new decision node, return the best reward plus afterstate value
+	 */
+	float expand(uint32_t d) {
+		nodes()[d].expanded = true;
+		float v = 0;
+		uint32_t tail = none;
+		bool legal = false;
+		float best = -std::numeric_limits<float>::max();
+		bool win = nodes()[d].state.is_win(); // the game ends here
+		if (win) v = -penalty;
+		for (unsigned op = 0; op < 4 && !win; op++) {
+			board after = nodes()[d].state;
+			board::reward reward = after.slide(op);
+			if (reward == -1) continue;
+			float value = after.is_win() ? -penalty : estimate(after, op);
+			best = std::max(best, reward + value);
+			legal = true;
+			uint32_t c = nodes().alloc();
+			if (c == none) continue; // the arena is full; the value is still counted
+			node& n = nodes()[c];
+			n.state = after;
+			n.reward = reward;
+			n.value = value;
+			n.op = op;
+			if (tail == none) nodes()[d].child = c;
+			else nodes()[tail].sibling = c;
+			tail = c;
+		}
+		if (legal) v = best;
+		if (legal && nodes()[d].child == none) nodes()[d].expanded = false; // retry once nodes are available
+		node& n = nodes()[d];
+		n.visits++;
+		n.value += (v - n.value) / n.visits;
+		return v;
+	}
+
+	/**
+	 * one iteration below a chance node, return the value of its afterstate
+	 */
+	float sample(uint32_t a) {
+		typedef board::rules::spawn spawn;
+		const board& after = nodes()[a].state;
+		std::array<int, board::cells> space;
+		int num = 0;
+		for (int i = 0; i < int(board::cells); i++)
+			if (after(i) == 0) space[num++] = i;
+		int pos = space[std::uniform_int_distribution<int>(0, num - 1)(engine)];
+		board::cell tile = spawn::tile(std::uniform_int_distribution<unsigned>(0, spawn::total - 1)(engine));
+		uint8_t key = uint8_t(pos * 2 + tile - 1);
+
+		uint32_t d = none, tail = none;
+		for (uint32_t c = nodes()[a].child; c != none && d == none; c = nodes()[c].sibling) {
+			if (nodes()[c].op == key) d = c;
+			tail = c;
+		}
+		if (d == none && (d = nodes().alloc()) != none) {
+			nodes()[d].state = after;
+			nodes()[d].state.place(pos, tile);
+			nodes()[d].op = key;
+			if (tail == none) nodes()[a].child = d;
+			else nodes()[tail].sibling = d;
+		}
+		float v = d != none ? decide(d) : nodes()[a].value; // the arena is full: keep the estimate
+
+		node& n = nodes()[a];
+		n.visits++;
+		n.value = n.visits == 1 ? v : n.value + (v - n.value) / n.visits;
+		return v;
+	}
+
+	/**
+	 * the afterstate value, evaluated incrementally from the last afterstate of the same slide,
+	 * e.g., the states of the placements on one afterstate share all rows or columns but one after the slide
+	 */
+	float estimate(const board& after, unsigned op) {
+		return net.empty() ? 0 : features.estimate(after, net, leaves[op]);
+	}
+
+	/**
+	 * e.g., "[搜索] 决策=1500 每步=12.30ms 迭代=1000/步 节点=81300/s 复用=35.2% 最大树=520000/1048576"
+	 */
+	void post() const {
+		if (!stat.moves) return;
+		std::stringstream line;
+		line << std::fixed << std::setprecision(2);
+		line << "[搜索] 决策=" << stat.moves;
+		line << " 每步=" << (stat.time * 1000 / stat.moves) << "ms";
+		line << std::setprecision(0) << " 迭代=" << (double(stat.iterations) / stat.moves) << "/步";
+		line << " 节点=" << (stat.time > 0 ? stat.created / stat.time : 0) << "/s";
+		line << std::setprecision(1) << " 复用=" << (100.0 * stat.reused / std::max<size_t>(stat.reused + stat.created, 1)) << "%";
+		line << " 最大树=" << stat.size << "/" << pools[0].capacity();
+		metrics::global().post("搜索", line.str());
+	}
+
+private:
+	size_t iterations;
+	double limit; // seconds per move
+	float explore;
+	bool reuse;
+	float penalty; // the cost of reaching the win condition
+	ntuple features;
+	std::array<ntuple::state, 4> leaves; // the incremental evaluation of each slide
+	std::default_random_engine engine;
+
+	std::array<tree, 2> pools;
+	unsigned current;
+	uint32_t root;
+	uint32_t last; // the chance node of the last slide
+
+	struct {
+		size_t moves = 0;
+		size_t iterations = 0;
+		size_t created = 0; // nodes created by the search
+		size_t reused = 0;  // nodes kept from the previous search
+		size_t size = 0;    // the largest tree
+		double time = 0;    // seconds
+	} stat;
+};
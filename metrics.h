@@ -0,0 +1,45 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * metrics.h: Registry of report lines posted by background components
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+/**
+ * report lines keyed by their source, e.g., a background evaluator
+ * components post their latest line at any time from any thread,
+ * and statistics::show prints the registered lines under its block report
+ */
+class metrics {
+public:
+	static metrics& global() {
+		static metrics registry;
+		return registry;
+	}
+
+	void post(const std::string& key, const std::string& line) {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries[key] = line;
+	}
+	void erase(const std::string& key) {
+		std::lock_guard<std::mutex> lock(mutex);
+		entries.erase(key);
+	}
+	std::vector<std::pair<std::string, std::string>> lines() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return { entries.begin(), entries.end() };
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::map<std::string, std::string> entries;
+};
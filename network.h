@@ -0,0 +1,212 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * network.h: Read-only n-tuple network with batched evaluation, shareable through a file mapping
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "board.h"
+#include "weight.h"
+#include "ntuple.h"
+#include "strategy.h"
+#include "checkpoint.h"
+
+/**
+ * read-only network for serving, i.e., evaluating boards without learning
+ *
+ * a checkpoint is mapped read-only and shared, so that processes serving the same file share its pages;
+ * the other formats are loaded into private tables
+ *
+ * the batched evaluation computes the indices of all boards first and prefetches them,
+ * then sums the weights, so that the cache misses of different boards overlap
+ */
+class network {
+public:
+	struct table {
+		const weight::type* data;
+		const hot_map* map; // the remapping
+		size_t size;
+		weight::type operator[](size_t i) const { return i < size ? data[map->slot(i)] : 0; }
+		const weight::type* address(size_t i) const { return i < size ? data + map->slot(i) : nullptr; }
+	};
+
+public:
+	network(const ntuple& features = ntuple(), const strategy& rule = strategy()) : features(features), rule(rule), map(nullptr), length(0) {}
+	network(const network&) = delete;
+	network& operator =(const network&) = delete;
+	~network() { close(); }
+
+	/**
+	 * open a weight file, return false on failure or if the tables do not fit the features
+	 * with 'adopt', the features take the cap recorded in the file (if any) rather than requiring the same one
+	 */
+	bool open(const std::string& path, bool adopt = false) {
+		close();
+		if (checkpoint::detect(path)) return open_mapped(path, adopt);
+		if (!checkpoint::load_any(path, owned, 1)) return false;
+		for (const weight& w : owned) {
+			if (w.is_paged()) return false;
+			tables.push_back({ w.data(), &w.mapping(), w.size() });
+		}
+		return fits(checkpoint::cap_of(owned), adopt) || (close(), false);
+	}
+
+	/**
+	 * use the given tables, which must outlive the network
+	 */
+	void assign(const std::vector<weight>& net) {
+		close();
+		for (const weight& w : net)
+			tables.push_back({ w.data(), &w.mapping(), w.is_paged() ? 0 : w.size() });
+	}
+
+	void close() {
+		if (map) ::munmap(map, length);
+		map = nullptr;
+		length = 0;
+		tables.clear();
+		owned.clear();
+		maps.clear();
+	}
+
+	size_t size() const { return tables.size(); }
+	bool is_mapped() const { return map != nullptr; }
+	const ntuple& pattern() const { return features; }
+
+public:
+	/**
+	 * the value of a board (as an afterstate)
+	 */
+	float estimate(const board& b) const {
+		size_t num = std::min(features.tuples(), tables.size()) * ntuple::isomorphisms;
+		float value = 0;
+		for (size_t f = 0; f < num; f++) value += tables[f / ntuple::isomorphisms][features.index(b, f)];
+		return value;
+	}
+
+	/**
+	 * the values of 'n' boards (as afterstates)
+	 */
+	void estimate(const board* b, size_t n, float* value) const {
+		size_t num = std::min(features.tuples(), tables.size()) * ntuple::isomorphisms;
+		scratch.resize(n * num);
+		for (size_t i = 0; i < n; i++) {
+			for (size_t f = 0; f < num; f++) {
+				const weight::type* p = tables[f / ntuple::isomorphisms].address(features.index(b[i], f));
+				scratch[i * num + f] = p;
+				if (p) __builtin_prefetch(p);
+			}
+		}
+		for (size_t i = 0; i < n; i++) {
+			float sum = 0;
+			for (size_t f = 0; f < num; f++) {
+				const weight::type* p = scratch[i * num + f];
+				sum += p ? *p : 0;
+			}
+			value[i] = sum;
+		}
+	}
+
+	/**
+	 * the moves of 'n' boards (as states), i.e., the slides maximizing reward plus afterstate value,
+	 * adjusted by the strategy as the strategic slider does (one ply, without its selective deepening)
+	 * the move is -1 (and the value is 0) if no slide is legal
+	 */
+	void choose(const board* b, size_t n, int* move, float* value) const {
+		after.resize(n * 4);
+		reward.resize(n * 4);
+		legal.clear();
+		for (size_t i = 0; i < n; i++) {
+			for (unsigned op = 0; op < 4; op++) {
+				board& a = after[i * 4 + op];
+				a = b[i];
+				reward[i * 4 + op] = a.slide(op);
+				if (reward[i * 4 + op] != -1) legal.push_back(a);
+			}
+		}
+		estimates.resize(legal.size());
+		estimate(legal.data(), legal.size(), estimates.data());
+		for (size_t i = 0, k = 0; i < n; i++) {
+			move[i] = -1;
+			value[i] = 0;
+			float best = -std::numeric_limits<float>::max();
+			for (unsigned op = 0; op < 4; op++) {
+				board::reward r = reward[i * 4 + op];
+				if (r == -1) continue;
+				float v = rule.apply(r + estimates[k++], after[i * 4 + op]);
+				if (v > best) best = v, move[i] = op, value[i] = v;
+			}
+		}
+	}
+
+private:
+	bool open_mapped(const std::string& path, bool adopt) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			::close(fd);
+			return false;
+		}
+		void* p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) return false;
+		map = p;
+		length = st.st_size;
+		const char* base = static_cast<const char*>(map);
+		const checkpoint::header& head = *reinterpret_cast<const checkpoint::header*>(base);
+		const checkpoint::entry* index = reinterpret_cast<const checkpoint::entry*>(base + sizeof(head));
+		if (sizeof(head) + sizeof(checkpoint::entry) * head.count > length) return close(), false;
+		for (size_t t = 0; t < head.count; t++) {
+			const checkpoint::entry& e = index[t];
+			if (e.offset + sizeof(weight::type) * e.size > length || e.order_offset + sizeof(uint32_t) * e.order_size > length)
+				return close(), false;
+			const uint32_t* hot = reinterpret_cast<const uint32_t*>(base + e.order_offset);
+			if (e.order_size > e.size || std::any_of(hot, hot + e.order_size, [&](uint32_t i) { return i >= e.size; }))
+				return close(), false;
+			maps.emplace_back(hot, size_t(e.order_size));
+		}
+		for (size_t t = 0; t < head.count; t++)
+			tables.push_back({ reinterpret_cast<const weight::type*>(base + index[t].offset), &maps[t], size_t(index[t].size) });
+		return fits(head.flags & 0xff, adopt) || (close(), false);
+	}
+
+	/**
+	 * whether the tables fit the features, i.e., the recorded cap (if any) is the same, and a tuple of n cells has cap^n entries
+	 * with 'adopt', the features take the recorded cap first
+	 */
+	bool fits(unsigned cap, bool adopt = false) {
+		if (adopt && cap && cap != features.cap()) features = ntuple(features.shapes(), cap);
+		if (cap && cap != features.cap()) return false;
+		for (size_t i = 0; i < std::min(features.tuples(), tables.size()); i++)
+			if (tables[i].size != features.span(i)) return false;
+		return true;
+	}
+
+private:
+	ntuple features;
+	strategy rule;
+	std::vector<table> tables;
+	std::vector<weight> owned;
+	std::vector<hot_map> maps; // the remappings of a mapped checkpoint
+	void* map;
+	size_t length;
+
+	mutable std::vector<const weight::type*> scratch;
+	mutable std::vector<board> after;
+	mutable std::vector<board::reward> reward;
+	mutable std::vector<board> legal;
+	mutable std::vector<float> estimates;
+};
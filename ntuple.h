@@ -0,0 +1,232 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * ntuple.h: Feature extraction and incremental evaluation for n-tuple network
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <cctype>
+#include <limits>
+#include "board.h"
+#include "weight.h"
+
+/**
+ * n-tuple feature set with its isomorphisms
+ *
+ * each tuple is evaluated under 8 isomorphisms, ordered as
+ *  (0) identity
+ *  (1) horizontal reflection
+ *  (2) vertical reflection
+ *  (3) transpose
+ *  (4) (3) then horizontal reflection
+ *  (5) (4) then vertical reflection
+ *  (6) (5) then transpose
+ *  (7) (6) then horizontal reflection
+ *
+ * a feature is a (tuple, isomorphism) pair, identified by tuple * 8 + isomorphism
+ * the index of a feature is the base-'cap' number of its tiles, the first cell being the least significant
+ * tiles not less than 'cap - 1' share the last bucket, e.g., with the default cap 16,
+ * 32768-tiles and larger are folded together; a cap of 32 distinguishes every tile up to 2^31
+ */
+class ntuple {
+public:
+	typedef std::vector<int> pattern;
+	static constexpr unsigned isomorphisms = 8;
+
+	struct dependency {
+		uint32_t feature;
+		uint64_t multiplier;
+	};
+
+public:
+	ntuple(const std::vector<pattern>& patterns = default_patterns(), unsigned cap = 16) : patterns(patterns), radix(cap) {
+		for (unsigned t = 0; t < folding.size(); t++) folding[t] = std::min(t, cap - 1);
+
+		std::array<std::array<int, board::cells>, isomorphisms> iso;
+		board b;
+		for (unsigned i = 0; i < board::cells; i++) b(i) = i;
+		iso[0] = cells(b);
+		b.reflect_horizontal(); iso[1] = cells(b); b.reflect_horizontal();
+		b.reflect_vertical(); iso[2] = cells(b); b.reflect_vertical();
+		b.transpose(); iso[3] = cells(b);
+		b.reflect_horizontal(); iso[4] = cells(b);
+		b.reflect_vertical(); iso[5] = cells(b);
+		b.transpose(); iso[6] = cells(b);
+		b.reflect_horizontal(); iso[7] = cells(b);
+
+		for (const pattern& p : patterns) {
+			for (unsigned s = 0; s < isomorphisms; s++) {
+				pattern cell;
+				for (int pos : p) cell.push_back(iso[s][pos]);
+				uint32_t feature = features.size();
+				uint64_t multiplier = 1;
+				for (int pos : cell) {
+					deps[pos].push_back({ feature, multiplier });
+					multiplier *= radix;
+				}
+				features.push_back(cell);
+			}
+		}
+	}
+
+public:
+	size_t size() const { return features.size(); }
+	size_t tuples() const { return patterns.size(); }
+	size_t length(size_t tuple) const { return patterns[tuple].size(); }
+	const std::vector<pattern>& shapes() const { return patterns; }
+	unsigned cap() const { return radix; }
+	const std::vector<dependency>& dependencies(unsigned pos) const { return deps[pos]; }
+
+	/**
+	 * the table size of a tuple, i.e., cap^n, or 0 if it exceeds size_t
+	 */
+	size_t span(size_t tuple) const {
+		size_t size = 1;
+		for (size_t k = 0; k < length(tuple); k++) {
+			if (size > std::numeric_limits<size_t>::max() / radix) return 0;
+			size *= radix;
+		}
+		return size;
+	}
+
+	/**
+	 * the bucket of a tile used by the index, by a table lookup rather than a comparison
+	 */
+	size_t fold(board::cell tile) const {
+		return folding[std::min<size_t>(tile, folding.size() - 1)];
+	}
+
+	/**
+	 * the table index of a feature
+	 */
+	size_t index(const board& b, size_t feature) const {
+		size_t index = 0, multiplier = 1;
+		for (int pos : features[feature]) {
+			index += fold(b(pos)) * multiplier;
+			multiplier *= radix;
+		}
+		return index;
+	}
+
+	/**
+	 * lookup a feature weight, an index out of the table is worth nothing
+	 */
+	static float lookup(const std::vector<weight>& net, size_t feature, size_t index) {
+		const weight& w = net[feature / isomorphisms];
+		return index < w.size() ? w[index] : 0.0f;
+	}
+
+	/**
+	 * the sum of all feature weights, tuples without a table are skipped
+	 */
+	float estimate(const board& b, const std::vector<weight>& net) const {
+		size_t num = std::min(tuples(), net.size()) * isomorphisms;
+		float value = 0;
+		for (size_t f = 0; f < num; f++) value += lookup(net, f, index(b, f));
+		return value;
+	}
+
+	/**
+	 * the cache of an incremental evaluation: the tiles of the last board, and the index and the weight of every feature
+	 * the weights are cached as they were looked up, thus reset() is needed once the tables have been updated
+	 */
+	struct state {
+		const std::vector<weight>* net = nullptr; // the tables looked up, null if nothing is cached
+		std::array<board::cell, board::cells> tile;
+		std::vector<size_t> index;
+		std::vector<float> value;
+		std::vector<uint32_t> mark;
+		std::vector<uint32_t> dirty;
+		uint32_t round = 0;
+
+		void reset() { net = nullptr; }
+	};
+
+	/**
+	 * the same sum as estimate(b, net), but only the features touching the cells that differ from
+	 * the last board of the cache are looked up again, e.g., the same slide after different placements
+	 * on one afterstate differs in a single row or column
+	 */
+	float estimate(const board& b, const std::vector<weight>& net, state& cache) const {
+		size_t num = std::min(tuples(), net.size()) * isomorphisms;
+		if (cache.net != &net || cache.index.size() != num) {
+			cache.net = &net;
+			cache.index.resize(num);
+			cache.value.resize(num);
+			cache.mark.assign(num, 0);
+			cache.round = 0;
+			for (size_t f = 0; f < num; f++) {
+				cache.index[f] = index(b, f);
+				cache.value[f] = lookup(net, f, cache.index[f]);
+			}
+			for (unsigned pos = 0; pos < board::cells; pos++) cache.tile[pos] = b(pos);
+		} else {
+			if (++cache.round == 0) cache.mark.assign(num, 0), cache.round = 1;
+			cache.dirty.clear();
+			for (unsigned pos = 0; pos < board::cells; pos++) {
+				if (cache.tile[pos] == b(pos)) continue;
+				size_t prev = fold(cache.tile[pos]), next = fold(b(pos));
+				cache.tile[pos] = b(pos);
+				if (prev == next) continue;
+				for (const dependency& dep : deps[pos]) {
+					if (dep.feature >= num) break;
+					cache.index[dep.feature] += (next - prev) * dep.multiplier;
+					if (cache.mark[dep.feature] != cache.round) {
+						cache.mark[dep.feature] = cache.round;
+						cache.dirty.push_back(dep.feature);
+					}
+				}
+			}
+			for (uint32_t f : cache.dirty) cache.value[f] = lookup(net, f, cache.index[f]);
+		}
+		float value = 0;
+		for (float v : cache.value) value += v;
+		return value;
+	}
+
+	/**
+	 * patterns written as hexadecimal cell positions separated by commas, e.g., "0123456,456789a"
+	 */
+	static std::vector<pattern> parse_patterns(const std::string& text) {
+		std::vector<pattern> patterns;
+		std::stringstream in(text);
+		for (std::string cells; std::getline(in, cells, ','); ) {
+			pattern p;
+			for (char ch : cells)
+				if (std::isxdigit(ch)) p.push_back(std::stoi(std::string(1, ch), nullptr, 16));
+			if (p.size()) patterns.push_back(p);
+		}
+		return patterns;
+	}
+
+	static std::vector<pattern> default_patterns() {
+		return {
+			{ 0, 1, 4, 5 },    // 左上角2x2
+			{ 2, 3, 6, 7 },    // 右上角2x2
+			{ 8, 9, 12, 13 },  // 左下角2x2
+			{ 10, 11, 14, 15 } // 右下角2x2
+		};
+	}
+
+private:
+	static std::array<int, board::cells> cells(const board& b) {
+		std::array<int, board::cells> res;
+		for (unsigned i = 0; i < board::cells; i++) res[i] = b(i);
+		return res;
+	}
+
+	std::vector<pattern> patterns;
+	unsigned radix;
+	std::array<uint8_t, 64> folding;
+	std::vector<pattern> features;
+	std::array<std::vector<dependency>, board::cells> deps;
+};
@@ -0,0 +1,45 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * options.h: Space-separated key=value options of agents and components
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <sstream>
+#include <map>
+#include <type_traits>
+
+/**
+ * the value of an option, converted to a string or a number as needed
+ */
+struct option {
+	std::string value;
+	operator std::string() const { return value; }
+	template<typename numeric, typename = typename std::enable_if<std::is_arithmetic<numeric>::value, numeric>::type>
+	operator numeric() const { return numeric(std::stod(value)); }
+};
+
+/**
+ * options parsed from space-separated key=value pairs, e.g., "alpha=0.1 load=weights.bin"
+ * a later pair overrides an earlier one with the same key, and a key without '=' is its own value
+ */
+class options : public std::map<std::string, option> {
+public:
+	options(const std::string& args = "") { parse(args); }
+
+	void parse(const std::string& args) {
+		std::stringstream ss(args);
+		for (std::string pair; ss >> pair; ) set(pair);
+	}
+
+	/**
+	 * set a single key=value pair
+	 */
+	void set(const std::string& pair) {
+		(*this)[pair.substr(0, pair.find('='))] = { pair.substr(pair.find('=') + 1) };
+	}
+};
@@ -0,0 +1,238 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * paired.h: Running confidence intervals and paired A/B reports
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <limits>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <memory>
+#include <algorithm>
+#include "options.h"
+
+/**
+ * running mean and variance of a sample (Welford's method)
+ */
+class running {
+public:
+	running() : num(0), avg(0), sq(0) {}
+
+	void add(double x) {
+		num++;
+		double delta = x - avg;
+		avg += delta / num;
+		sq += delta * (x - avg);
+	}
+
+	size_t count() const { return num; }
+	double mean() const { return avg; }
+	double variance() const { return num > 1 ? sq / (num - 1) : 0; }
+
+	/**
+	 * the half width of the confidence interval of the mean, for the z-score of the level
+	 */
+	double half(double z) const { return num ? z * std::sqrt(variance() / num) : 0; }
+
+private:
+	size_t num;
+	double avg;
+	double sq;
+};
+
+/**
+ * the z-score of a two-sided confidence level, e.g., 1.96 for 0.95
+ */
+inline double normal_quantile(double level) {
+	double p = 0.5 + std::min(std::max(level, 0.0), 0.999999) / 2;
+	double lo = 0, hi = 10;
+	for (int i = 0; i < 100; i++) {
+		double mid = (lo + hi) / 2;
+		if (0.5 * std::erfc(-mid / std::sqrt(2.0)) < p) lo = mid;
+		else hi = mid;
+	}
+	return (lo + hi) / 2;
+}
+
+/**
+ * the Wilson interval of a rate of k in n, for the z-score of the level
+ */
+inline std::pair<double, double> wilson(size_t k, size_t n, double z) {
+	if (!n) return { 0, 1 };
+	double p = double(k) / n, zz = z * z / n;
+	double center = (p + zz / 2) / (1 + zz);
+	double half = z * std::sqrt(p * (1 - p) / n + zz / (4 * n)) / (1 + zz);
+	return { std::max(center - half, 0.0), std::min(center + half, 1.0) };
+}
+
+/**
+ * sequential stopping rule, deciding whether the mean score (or score difference) is above or below
+ * 'score', and whether the rate of games avoiding the win condition is above or below 'avoid'
+ *
+ * the results are looked at every 'every' games from 'min' games on; with m thresholds given,
+ * look k tests each of them at the level 1 - (1 - level) / (m k (k + 1)), so that the error over
+ * all looks and thresholds stays within 1 - level, and the decision is settled once every interval
+ * excludes its threshold
+ * the mean score uses the normal interval, the avoidance rate uses the Wilson interval
+ *
+ * arguments (space-separated): score= avoid= level=0.95 every=10 min=20
+ */
+class sequential {
+public:
+	sequential(const std::string& args = "") : score(nan()), avoid(nan()), level(0.95), every(10), min(20),
+		looks(0), z(normal_quantile(level)), decided(0) {
+		options meta(args);
+		if (meta.count("score")) score = double(meta["score"]);
+		if (meta.count("avoid")) avoid = double(meta["avoid"]);
+		if (meta.count("level")) level = std::min(std::max(double(meta["level"]), 0.5), 0.9999);
+		if (meta.count("every")) every = std::max<size_t>(size_t(meta["every"]), 1);
+		if (meta.count("min")) min = size_t(meta["min"]);
+		z = normal_quantile(level);
+	}
+
+	/**
+	 * look at the results after a game, return true once the decision is settled
+	 */
+	bool look(const running& scores, size_t wins) {
+		size_t n = scores.count();
+		if (decided || n < std::max<size_t>(min, 2) || n % every || !tests()) return decided;
+		looks++;
+		z = normal_quantile(1 - (1 - level) / (tests() * looks * (looks + 1.0)));
+		bool settled = true;
+		if (score == score) {
+			double h = scores.half(z);
+			settled &= (scores.mean() - h > score || scores.mean() + h < score);
+		}
+		if (avoid == avoid) {
+			std::pair<double, double> in = wilson(n - wins, n, z);
+			settled &= (in.first > avoid || in.second < avoid);
+		}
+		if (settled) decided = n;
+		return decided;
+	}
+
+	bool settled() const { return decided; }
+
+	/**
+	 * the number of thresholds given, among which the error is split
+	 */
+	size_t tests() const { return (score == score) + (avoid == avoid); }
+
+	/**
+	 * e.g.,
+	 * "[停止] 规则: 平均分对12000 避免率对95.0% 置信95% 每10局检查 (第k次检查每项的置信水平为1-2.5%/(k(k+1)))"
+	 * "[停止] 第60局判定: 平均分=13420±850 (高于12000) 避免率=100.0% [95.6%, 100.0%] (高于95.0%)"
+	 */
+	void show(const running& scores, size_t wins, const std::string& what = "平均分") const {
+		size_t n = scores.count();
+		std::ios ff(nullptr);
+		ff.copyfmt(std::cout);
+		std::cout << std::fixed << std::setprecision(1);
+		std::cout << "[停止] 规则:";
+		if (score == score) std::cout << " " << what << "对" << std::setprecision(0) << score << std::setprecision(1);
+		if (avoid == avoid) std::cout << " 避免率对" << (avoid * 100) << "%";
+		if (score != score && avoid != avoid) std::cout << " 无 (只报告区间)";
+		std::cout << " 置信" << (level * 100) << "% 每" << every << "局检查";
+		std::cout << " (第k次检查" << (tests() > 1 ? "每项" : "") << "的置信水平为1-" << ((1 - level) * 100 / std::max<size_t>(tests(), 1)) << "%/(k(k+1)))" << std::endl;
+
+		std::cout << "[停止] " << (decided ? "第" + std::to_string(decided) + "局判定" : "达到" + std::to_string(n) + "局未判定") << ":";
+		std::cout << std::setprecision(0) << " " << what << "=" << scores.mean() << "±" << scores.half(z);
+		if (score == score && decided) std::cout << " (" << (scores.mean() > score ? "高于" : "低于") << score << ")";
+		if (n) {
+			std::pair<double, double> in = wilson(n - wins, n, z);
+			std::cout << std::setprecision(1) << " 避免率=" << (100.0 * (n - wins) / n) << "%";
+			std::cout << " [" << (in.first * 100) << "%, " << (in.second * 100) << "%]";
+			if (avoid == avoid && decided) std::cout << " (" << (in.first > avoid ? "高于" : "低于") << (avoid * 100) << "%)";
+		}
+		std::cout << std::endl;
+		std::cout.copyfmt(ff);
+	}
+
+private:
+	static double nan() { return std::numeric_limits<double>::quiet_NaN(); }
+
+private:
+	double score;
+	double avoid;
+	double level;
+	size_t every;
+	size_t min;
+	size_t looks;
+	double z;      // the z-score of the last look
+	size_t decided; // the game of the decision, 0 if not settled
+};
+
+/**
+ * paired report of two sliders playing the same placement streams
+ *
+ * game g of both sliders draws its placements from the same keyed random streams (see random_placer),
+ * so the scores of a pair are correlated, and the variance of their difference is much lower than
+ * the sum of their variances; the interval of the mean difference thus narrows with fewer games
+ * than comparing two independent runs, whose interval is also shown with the equivalent game factor
+ */
+class paired {
+public:
+	paired(size_t block, double level = 0.95) : block(block ? block : size_t(-1)), level(level), z(normal_quantile(level)) {}
+
+	void add(double a, double b, bool win_a, bool win_b) {
+		score_a.add(a);
+		score_b.add(b);
+		diff.add(a - b);
+		wins_a += win_a;
+		wins_b += win_b;
+		if (diff.count() % block == 0) show();
+		if (rule) rule->look(diff, wins_a);
+	}
+
+	/**
+	 * stop once the score difference is settled against 'score' (see sequential)
+	 */
+	void stop_when(const std::string& args) {
+		rule.reset(new sequential(args));
+	}
+	bool settled() const { return rule && rule->settled(); }
+
+	/**
+	 * show the report unless it has just been shown at the end of a block, and the stopping rule
+	 */
+	void summary() const {
+		if (diff.count() % block) show();
+		if (rule) rule->show(diff, wins_a, "分数差(A)");
+	}
+
+	/**
+	 * e.g., "[配对] 1000局: A=12345 B=12000 差=345±120 (95%) 独立对局时±410 (等效11.7倍局数) 胜利 A=1.2% B=0.8%"
+	 */
+	void show() const {
+		size_t n = diff.count();
+		if (!n) return;
+		double independent = z * std::sqrt((score_a.variance() + score_b.variance()) / n);
+		std::ios ff(nullptr);
+		ff.copyfmt(std::cout);
+		std::cout << std::fixed << std::setprecision(0);
+		std::cout << "[配对] " << n << "局: A=" << score_a.mean() << " B=" << score_b.mean();
+		std::cout << " 差=" << std::showpos << diff.mean() << std::noshowpos << "±" << diff.half(z);
+		std::cout << " (" << (level * 100) << "%) 独立对局时±" << independent;
+		if (diff.variance() > 0)
+			std::cout << std::setprecision(1) << " (等效" << (score_a.variance() + score_b.variance()) / diff.variance() << "倍局数)";
+		std::cout << std::setprecision(1) << " 胜利 A=" << (wins_a * 100.0 / n) << "% B=" << (wins_b * 100.0 / n) << "%";
+		std::cout << std::endl;
+		std::cout.copyfmt(ff);
+	}
+
+	const running& difference() const { return diff; }
+
+private:
+	size_t block;
+	double level;
+	double z;
+	running score_a, score_b, diff;
+	size_t wins_a = 0, wins_b = 0;
+	std::unique_ptr<sequential> rule;
+};
@@ -0,0 +1,101 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * pool.h: Pool of late-game start states sampled from earlier episodes
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include "options.h"
+#include "board.h"
+#include "action.h"
+#include "episode.h"
+
+/**
+ * start-state pool for seeding new episodes with late-game states
+ *
+ * episodes whose largest tile reaches 'tile' (index value, 12 for 4096 by default) are sampled:
+ * up to 'sample' states (after a slide, before a placement) are taken from the moves after
+ * the largest tile first reaches 'tile', and are kept as packed boards in a reservoir of 'size' states
+ * a new episode starts from a pooled state with probability 'ratio'
+ *
+ * note that an episode started from a pooled state still begins with two placements
+ *
+ * arguments (space-separated): ratio=0.25 size=65536 tile=12 sample=4 seed=0
+ */
+class start_pool {
+public:
+	start_pool(const std::string& args = "") : ratio(0), size(65536), tile(12), sample(4), offered(0), drawn(0) {
+		options meta(args);
+		if (meta.count("ratio")) ratio = double(meta["ratio"]);
+		if (meta.count("size")) size = size_t(meta["size"]);
+		if (meta.count("tile")) tile = unsigned(meta["tile"]);
+		if (meta.count("sample")) sample = unsigned(meta["sample"]);
+		if (meta.count("seed")) engine.seed(unsigned(meta["seed"]));
+		states.reserve(std::min<size_t>(size, 65536));
+	}
+
+public:
+	/**
+	 * draw a start state for a new episode
+	 * return false if the episode should start from the empty board
+	 */
+	bool draw(board& start) {
+		if (states.empty() || ratio <= 0) return false;
+		if (std::uniform_real_distribution<double>(0, 1)(engine) >= ratio) return false;
+		start = board(states[std::uniform_int_distribution<size_t>(0, states.size() - 1)(engine)]);
+		drawn++;
+		return true;
+	}
+
+	/**
+	 * sample states from a finished episode if it reached the tile
+	 */
+	void collect(const episode& ep) {
+		if (ratio <= 0 || size == 0) return;
+		board b = ep.start();
+		std::vector<board::packed> late;
+		for (const action& move : ep.actions()) {
+			move.apply(b);
+			if (move.type() != action::slide::type) continue;
+			if (b.max_tile_value() < int(tile)) continue;
+			if (std::count(b.begin(), b.end(), 0u) < 2) continue; // room for two placements
+			late.push_back(b.pack());
+		}
+		std::shuffle(late.begin(), late.end(), engine);
+		if (late.size() > sample) late.resize(sample);
+		for (const board::packed& p : late) insert(p);
+	}
+
+	size_t count() const { return states.size(); }
+	size_t draws() const { return drawn; }
+
+private:
+	/**
+	 * reservoir sampling over all offered states
+	 */
+	void insert(const board::packed& p) {
+		offered++;
+		if (states.size() < size) {
+			states.push_back(p);
+		} else {
+			size_t i = std::uniform_int_distribution<size_t>(0, offered - 1)(engine);
+			if (i < size) states[i] = p;
+		}
+	}
+
+private:
+	double ratio;
+	size_t size;
+	unsigned tile;
+	size_t sample;
+	size_t offered;
+	size_t drawn;
+	std::vector<board::packed> states;
+	std::default_random_engine engine;
+};
@@ -8,7 +8,7 @@ echo
 
 # 阶段1: 基础学习 (100局)
 echo "阶段1: 基础学习 (100局)"
-./2048 --total=100 --slide="init=1000,1000,1000,1000 alpha=0.1 learning=1 penalty=0.0 bonus=100" --save=test_stage1.w
+./2048 --total=100 --slide="init=65536,65536,65536,65536 alpha=0.1 learning=1 penalty=0.0 bonus=100" --save=test_stage1.w
 
 echo
 echo "阶段2: 危险感知 (100局)" 
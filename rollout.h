@@ -0,0 +1,349 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * rollout.h: Monte Carlo rollout slider with parallel playouts and sequential halving
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <array>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "metrics.h"
+
+/**
+ * persistent worker threads running the iterations of a loop
+ * the calling thread takes part in the loop, thus 'threads' = 1 runs everything on the caller
+ */
+class worker_pool {
+public:
+	worker_pool(size_t threads = 1) : round(0), total(0), next(0), done(0), stopping(false) {
+		for (size_t i = 1; i < threads; i++) workers.emplace_back(&worker_pool::work, this);
+	}
+	worker_pool(const worker_pool&) = delete;
+	worker_pool& operator =(const worker_pool&) = delete;
+	~worker_pool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers) t.join();
+	}
+
+	size_t size() const { return workers.size() + 1; }
+
+	/**
+	 * call task(0), task(1), ..., task(n - 1) on the workers, and wait for all of them
+	 */
+	void run(size_t n, const std::function<void(size_t)>& task) {
+		if (workers.empty() || n < 2) {
+			for (size_t i = 0; i < n; i++) task(i);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &task;
+			total = n;
+			next = 0;
+			done = 0;
+			round++;
+		}
+		wake.notify_all();
+		size_t own = execute();
+		std::unique_lock<std::mutex> lock(mutex);
+		done += own;
+		finish.wait(lock, [&]() { return done == total; });
+		job = nullptr;
+	}
+
+private:
+	size_t execute() {
+		size_t count = 0;
+		for (size_t i; (i = next.fetch_add(1)) < total; count++) (*job)(i);
+		return count;
+	}
+
+	void work() {
+		size_t seen = 0;
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || round != seen; });
+				if (stopping) return;
+				seen = round;
+			}
+			size_t count = execute();
+			std::lock_guard<std::mutex> lock(mutex);
+			done += count;
+			if (done == total) finish.notify_one();
+		}
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable finish;
+	const std::function<void(size_t)>* job = nullptr;
+	size_t round;
+	size_t total;
+	std::atomic<size_t> next;
+	size_t done;
+	bool stopping;
+};
+
+/**
+ * Monte Carlo rollout slider, i.e., no trained network is needed
+ *
+ * each legal slide is followed by playouts against the random placer, and the slide with
+ * the highest reward plus mean playout return is selected; a playout ends when no slide is legal,
+ * when the win condition is reached (at the cost of 'win'), or after 'depth' slides (0 for no limit)
+ * the playout policy is either random (uniform over legal slides) or greedy (the largest merge reward)
+ *
+ * with sequential halving, the budget of 'k' playouts per legal slide is split into rounds,
+ * and the worse half of the remaining slides is rejected after each round
+ * playout j of slide op uses its own random engine derived from the seed of the decision,
+ * so that the decision does not depend on the number of threads
+ *
+ * arguments: search=rollout k=32 depth=0 policy=random|greedy halving=1 threads=1 win=50000 seed=
+ */
+class rollout_slider : public random_agent {
+public:
+	rollout_slider(const std::string& args = "") : random_agent("name=rollout role=slider " + args),
+		playouts(32), depth(0), greedy(false), halving(true), penalty(50000) {
+		if (meta.find("k") != meta.end())
+			playouts = std::max<size_t>(size_t(meta["k"]), 1);
+		if (meta.find("depth") != meta.end())
+			depth = size_t(meta["depth"]);
+		if (meta.find("policy") != meta.end())
+			greedy = (std::string(meta["policy"]) == "greedy");
+		if (meta.find("halving") != meta.end())
+			halving = int(meta["halving"]);
+		if (meta.find("win") != meta.end())
+			penalty = float(meta["win"]);
+		size_t threads = meta.find("threads") != meta.end() ? std::max<size_t>(size_t(meta["threads"]), 1) : 1;
+		pool.reset(new worker_pool(threads));
+	}
+	virtual ~rollout_slider() {
+		metrics::global().erase("推演");
+	}
+
+	virtual action take_action(const board& before) override {
+		typedef std::chrono::steady_clock clock;
+		auto begin = clock::now();
+
+		// expand the legal slides
+		std::vector<candidate> moves;
+		for (unsigned op = 0; op < 4; op++) {
+			candidate c = { op, before, 0, 0, 0 };
+			c.reward = c.after.slide(op);
+			if (c.reward != -1) moves.push_back(c);
+		}
+		uint64_t base = engine();
+		auto expanded = clock::now();
+
+		// run the playouts round by round, rejecting the worse half after each round
+		if (moves.size() > 1) {
+			size_t rounds = halving ? ceil_log2(moves.size()) : 1;
+			size_t budget = playouts * moves.size();
+			std::vector<candidate*> alive;
+			for (candidate& c : moves) alive.push_back(&c);
+			for (size_t r = 0; r < rounds; r++) {
+				size_t each = std::max<size_t>(budget / (alive.size() * rounds), 1);
+				simulate(alive, each, base);
+				if (r + 1 == rounds) break;
+				std::sort(alive.begin(), alive.end(), [](const candidate* a, const candidate* b) { return a->value() > b->value(); });
+				stat.rejected += alive.size() - (alive.size() + 1) / 2;
+				alive.resize((alive.size() + 1) / 2);
+			}
+		}
+		auto simulated = clock::now();
+
+		// select the slide with the highest estimated value among the remaining ones
+		action best;
+		float value = -std::numeric_limits<float>::max();
+		for (const candidate& c : moves) {
+			if (c.count < max_count(moves)) continue;
+			if (c.value() > value) value = c.value(), best = action::slide(c.op);
+		}
+		auto selected = clock::now();
+
+		stat.moves++;
+		stat.expand += std::chrono::duration<double>(expanded - begin).count();
+		stat.simulate += std::chrono::duration<double>(simulated - expanded).count();
+		stat.select += std::chrono::duration<double>(selected - simulated).count();
+		return best;
+	}
+
+	virtual bool check_for_win(const board& b) override {
+		return b.is_win();
+	}
+
+	virtual void close_episode(const std::string& flag = "") override {
+		post();
+	}
+
+private:
+	struct candidate {
+		unsigned op;
+		board after;
+		board::reward reward;
+		size_t count;  // playouts run
+		double total;  // sum of the playout returns
+		double value() const { return reward + (count ? total / count : 0); }
+	};
+
+	static size_t ceil_log2(size_t n) {
+		size_t k = 0;
+		while ((size_t(1) << k) < n) k++;
+		return k;
+	}
+	static size_t max_count(const std::vector<candidate>& moves) {
+		size_t count = 0;
+		for (const candidate& c : moves) count = std::max(count, c.count);
+		return count;
+	}
+
+	/**
+	 * the seed of playout j of slide op, mixed by splitmix64
+	 */
+	static uint64_t mix(uint64_t base, unsigned op, size_t j) {
+		uint64_t z = base + (uint64_t(op) << 40) + j + 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	/**
+	 * run 'each' more playouts for every given slide on the worker pool
+	 */
+	void simulate(const std::vector<candidate*>& alive, size_t each, uint64_t base) {
+		size_t n = alive.size() * each;
+		std::vector<double> result(n);
+		std::vector<size_t> steps(n);
+		pool->run(n, [&](size_t i) {
+			const candidate& c = *alive[i / each];
+			std::default_random_engine rng(mix(base, c.op, c.count + i % each));
+			result[i] = playout(c.after, rng, steps[i]);
+		});
+		for (size_t i = 0; i < n; i++) {
+			candidate& c = *alive[i / each];
+			c.total += result[i];
+			stat.steps += steps[i];
+		}
+		for (candidate* c : alive) c->count += each;
+		stat.playouts += n;
+	}
+
+	/**
+	 * play from an afterstate against the random placer, return the sum of the rewards
+	 */
+	double playout(board b, std::default_random_engine& rng, size_t& steps) const {
+		typedef board::rules::spawn spawn;
+		static const std::array<std::array<uint8_t, 4>, 24> orders = permutations();
+		std::uniform_int_distribution<unsigned> popup(0, spawn::total - 1);
+		std::array<int, board::cells> space;
+		double sum = 0;
+		for (steps = 0; depth == 0 || steps < depth; ) {
+			int num = 0;
+			for (int i = 0; i < int(board::cells); i++)
+				if (b(i) == 0) space[num++] = i;
+			if (num == 0) break;
+			int pos = space[std::uniform_int_distribution<int>(0, num - 1)(rng)];
+			b.place(pos, spawn::tile(popup(rng)));
+
+			const std::array<uint8_t, 4>& order = orders[std::uniform_int_distribution<int>(0, 23)(rng)];
+			board::reward reward = -1;
+			if (greedy) {
+				board best;
+				for (unsigned op : order) {
+					board a = b;
+					board::reward r = a.slide(op);
+					if (r > reward) reward = r, best = a;
+				}
+				if (reward != -1) b = best;
+			} else {
+				for (unsigned op : order) {
+					board a = b;
+					reward = a.slide(op);
+					if (reward != -1) {
+						b = a;
+						break;
+					}
+				}
+			}
+			if (reward == -1) break;
+			sum += reward;
+			steps++;
+			if (b.is_win()) {
+				sum -= penalty;
+				break;
+			}
+		}
+		return sum;
+	}
+
+	static std::array<std::array<uint8_t, 4>, 24> permutations() {
+		std::array<std::array<uint8_t, 4>, 24> orders;
+		std::array<uint8_t, 4> op = {{ 0, 1, 2, 3 }};
+		for (auto& order : orders) {
+			order = op;
+			std::next_permutation(op.begin(), op.end());
+		}
+		return orders;
+	}
+
+	/**
+	 * e.g., "[推演] 决策=1200 每步=2.15ms (展开0.0% 推演99.8% 选择0.2%) 推演=153600次 (59535次/s) 平均长度=98.2 淘汰=0.85/步"
+	 */
+	void post() const {
+		if (!stat.moves) return;
+		double time = stat.expand + stat.simulate + stat.select;
+		std::stringstream line;
+		line << std::fixed << std::setprecision(1);
+		line << "[推演] 决策=" << stat.moves;
+		line << " 每步=" << std::setprecision(2) << (time * 1000 / stat.moves) << "ms" << std::setprecision(1);
+		line << " (展开" << (stat.expand * 100 / time) << "% 推演" << (stat.simulate * 100 / time) << "% 选择" << (stat.select * 100 / time) << "%)";
+		line << " 推演=" << stat.playouts << "次 (" << std::setprecision(0) << (stat.simulate > 0 ? stat.playouts / stat.simulate : 0) << "次/s)";
+		line << std::setprecision(1) << " 平均长度=" << (stat.playouts ? double(stat.steps) / stat.playouts : 0);
+		line << std::setprecision(2) << " 淘汰=" << (double(stat.rejected) / stat.moves) << "/步";
+		if (pool->size() > 1) line << " 线程=" << pool->size();
+		metrics::global().post("推演", line.str());
+	}
+
+private:
+	size_t playouts;
+	size_t depth;
+	bool greedy;
+	bool halving;
+	float penalty;
+	std::unique_ptr<worker_pool> pool;
+
+	struct {
+		size_t moves = 0;
+		size_t playouts = 0;
+		size_t steps = 0;
+		size_t rejected = 0;
+		double expand = 0;   // seconds
+		double simulate = 0;
+		double select = 0;
+	} stat;
+};
@@ -0,0 +1,78 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * rules.h: Compile-time game rules for 2048 and its variants
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+
+namespace rules {
+
+/**
+ * win predicate: at least 'count' tiles of the given value (index form)
+ * e.g., reach<13, 2> is won with two 8192-tiles
+ */
+template<unsigned tile, unsigned count = 1>
+struct reach {
+	static constexpr unsigned target = tile;
+	static constexpr unsigned needed = count;
+
+	template<class board>
+	static bool test(const board& b) {
+		unsigned num = 0;
+		for (unsigned i = 0; i < board::cells; i++) num += (b(i) == tile);
+		return num >= count;
+	}
+};
+
+/**
+ * win predicate for games without winning, i.e., played until no legal move
+ */
+struct endless {
+	static constexpr unsigned target = 0;
+	static constexpr unsigned needed = 0;
+
+	template<class board>
+	static bool test(const board& b) { return false; }
+};
+
+/**
+ * spawn distribution: a uniform draw in [0, range) popups a 4-tile if it is below 'four'
+ * e.g., spawn<1, 10> popups 2-tiles with 90% and 4-tiles with 10%
+ */
+template<unsigned four, unsigned range>
+struct spawn {
+	static_assert(four <= range && range > 0, "invalid spawn distribution");
+	static constexpr unsigned total = range;
+	static unsigned tile(unsigned draw) { return draw < four ? 2 : 1; }
+};
+
+/**
+ * the rules of a game variant
+ * the board dimensions, the win predicate, and the spawn distribution
+ */
+template<unsigned row, unsigned column, class win_rule, class spawn_rule>
+struct basic {
+	static_assert(row >= 2 && column >= 2 && row <= 8 && column <= 8, "unsupported board dimensions");
+	static constexpr unsigned rows = row;
+	static constexpr unsigned cols = column;
+	static constexpr unsigned cells = row * column;
+	typedef win_rule win;
+	typedef spawn_rule spawn;
+};
+
+/**
+ * 4x4, two 8192-tiles win, 90% 2-tiles and 10% 4-tiles
+ */
+typedef basic<4, 4, reach<13, 2>, spawn<1, 10>> standard;
+
+/**
+ * research variants
+ * note that actions, episodes, and packed boards address at most 16 cells
+ */
+typedef basic<3, 3, reach<9>, spawn<1, 10>> small;
+
+} // namespace rules
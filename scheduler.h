@@ -0,0 +1,153 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * scheduler.h: Interleaved scheduling of many greedy games per thread to overlap weight lookups
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <array>
+#include <random>
+#include <limits>
+#include <cstdint>
+#include "board.h"
+#include "weight.h"
+#include "ntuple.h"
+#include "strategy.h"
+
+/**
+ * scheduler interleaving 'width' greedy games on one thread
+ *
+ * each game is a resumable task (a stackless state machine) suspended at its evaluation point:
+ * a round first resumes every task up to the point where it has generated its afterstates and
+ * prefetched their weights, then resumes every task again to sum the (now cached) weights,
+ * slide, and place a tile; a finished game is replaced by a new one until 'games' are started
+ * thus the DRAM latency of the lookups of one game overlaps with the work of the others
+ *
+ * the games are greedy, i.e., always the slide maximizing the reward plus the afterstate value,
+ * adjusted by the given strategy as the strategic slider does (see strategy)
+ * game k uses its own random engine seeded by seed + k, so the results do not depend on 'width',
+ * and every network is evaluated on the same sequence of tile placements as long as its moves agree
+ */
+class scheduler {
+public:
+	struct result {
+		board::score score;
+		unsigned tile;  // largest tile (index form)
+		unsigned steps; // slides played
+		bool win;
+	};
+
+	scheduler(const ntuple& features, size_t width = 64, unsigned seed = 0, const strategy& rule = strategy())
+		: features(features), rule(rule), width(std::max<size_t>(width, 1)), seed(seed) {}
+
+	/**
+	 * play games first, first + 1, ..., first + games - 1 on the given weights
+	 */
+	std::vector<result> play(const std::vector<weight>& net, size_t games, size_t first = 0) {
+		size_t num = std::min(features.tuples(), net.size()) * ntuple::isomorphisms;
+		std::vector<result> res(games);
+		std::vector<task> tasks(std::min(width, games));
+		for (task& t : tasks) t.address.resize(4 * num);
+		size_t started = 0, active = 0;
+		for (task& t : tasks) {
+			t.start(first + started++, seed);
+			active++;
+		}
+
+		while (active) {
+			// resume each task until its afterstates are generated and their weights are prefetched
+			for (task& t : tasks) {
+				if (t.done) continue;
+				for (unsigned op = 0; op < 4; op++) {
+					t.after[op] = t.state;
+					t.reward[op] = t.after[op].slide(op);
+					if (t.reward[op] == -1) continue;
+					for (size_t f = 0; f < num; f++) {
+						const weight& w = net[f / ntuple::isomorphisms];
+						size_t i = features.index(t.after[op], f);
+						const weight::type* p = i < w.size() ? &w[i] : nullptr;
+						t.address[op * num + f] = p;
+						if (p) __builtin_prefetch(p);
+					}
+				}
+			}
+			// resume each task to evaluate, slide, and place; replace the finished games
+			for (task& t : tasks) {
+				if (t.done) continue;
+				int best = -1;
+				float value = -std::numeric_limits<float>::max();
+				for (unsigned op = 0; op < 4; op++) {
+					if (t.reward[op] == -1) continue;
+					float v = t.reward[op];
+					for (size_t f = 0; f < num; f++) {
+						const weight::type* p = t.address[op * num + f];
+						v += p ? *p : 0;
+					}
+					v = rule.apply(v, t.after[op]);
+					if (v > value) value = v, best = op;
+				}
+				if (best != -1) {
+					t.state = t.after[best];
+					t.score += t.reward[best];
+					t.steps++;
+					t.win = t.state.is_win();
+					if (!t.win) t.place();
+				}
+				if (best == -1 || t.win) {
+					res[t.id - first] = { t.score, unsigned(t.state.max_tile_value()), t.steps, t.win };
+					if (started < games) {
+						t.start(first + started++, seed);
+					} else {
+						t.done = true;
+						active--;
+					}
+				}
+			}
+		}
+		return res;
+	}
+
+private:
+	struct task {
+		size_t id;
+		board state;
+		board::score score;
+		unsigned steps;
+		bool win;
+		bool done;
+		std::default_random_engine engine;
+		std::array<board, 4> after;
+		std::array<board::reward, 4> reward;
+		std::vector<const weight::type*> address; // [op * features + feature]
+
+		void start(size_t k, unsigned seed) {
+			id = k;
+			state = board();
+			score = 0;
+			steps = 0;
+			win = done = false;
+			engine.seed(seed + k);
+			place();
+			place();
+		}
+		void place() {
+			typedef board::rules::spawn spawn;
+			std::array<int, board::cells> space;
+			int num = 0;
+			for (int i = 0; i < int(board::cells); i++)
+				if (state(i) == 0) space[num++] = i;
+			if (num == 0) return;
+			int pos = space[std::uniform_int_distribution<int>(0, num - 1)(engine)];
+			state.place(pos, spawn::tile(std::uniform_int_distribution<unsigned>(0, spawn::total - 1)(engine)));
+		}
+	};
+
+	ntuple features;
+	strategy rule;
+	size_t width;
+	unsigned seed;
+};
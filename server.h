@@ -0,0 +1,274 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * server.h: Local move server on a Unix domain socket with request batching
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "options.h"
+#include "board.h"
+#include "ntuple.h"
+#include "network.h"
+
+/**
+ * move server, answering the move of a board over a Unix domain socket, chosen as the strategic slider does in one ply
+ *
+ * a request is 16 bytes: the packed board (uint64 nibbles, uint16 high bits), uint16 flags (0), and uint32 tag
+ * a response is 16 bytes: uint32 tag, int32 move (0: up, 1: right, 2: down, 3: left, -1: none),
+ * float value (reward plus afterstate value, adjusted by the strategy), and uint32 reserved (0), all in host byte order
+ * a client may pipeline requests; the responses of a connection follow the order of its requests
+ *
+ * the requests received in one polling round, from all connections, are evaluated as batches of
+ * up to 'batch' boards (see network::choose); the weights are served from a read-only mapping
+ * when the weight file is a checkpoint, so that several servers share one copy
+ *
+ * the throughput and the latency percentiles (from receiving to replying) are reported every 'report' seconds
+ *
+ * arguments (space-separated): path=/tmp/2048.sock load=<weights> tuple= cap=16 penalty=0.7 bonus=1000 batch=256 report=10 limit=0
+ * where cap defaults to the one recorded in the weights (16 if none),
+ * and penalty and bonus are those of the strategic slider (see strategy), 0 for both gives the plain greedy move
+ */
+class move_server {
+public:
+	struct request {
+		uint64_t nibble;
+		uint16_t high;
+		uint16_t flags;
+		uint32_t tag;
+	};
+	struct response {
+		uint32_t tag;
+		int32_t move;
+		float value;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(request) == 16 && sizeof(response) == 16, "unexpected wire format");
+
+public:
+	move_server(const std::string& args = "") : path("/tmp/2048.sock"), batch(256), interval(10), limit(0), listener(-1) {
+		options meta(args);
+		if (meta.count("path")) path = std::string(meta["path"]);
+		if (meta.count("batch")) batch = std::max<size_t>(size_t(meta["batch"]), 1);
+		if (meta.count("report")) interval = double(meta["report"]);
+		if (meta.count("limit")) limit = size_t(meta["limit"]);
+		unsigned cap = meta.count("cap") ? std::min(std::max(unsigned(meta["cap"]), 2u), 64u) : 16;
+		std::vector<ntuple::pattern> patterns = meta.count("tuple") ? ntuple::parse_patterns(meta["tuple"]) : ntuple::default_patterns();
+		strategy rule;
+		if (meta.count("penalty")) rule.penalty = float(meta["penalty"]);
+		if (meta.count("bonus")) rule.bonus = float(meta["bonus"]);
+		net.reset(new network(ntuple(patterns, cap), rule));
+		if (meta.count("load") && !net->open(meta["load"], !meta.count("cap"))) {
+			std::cerr << "cannot load " << std::string(meta["load"]) << ", or its tables do not fit the tuples and cap" << std::endl;
+			std::exit(-1);
+		}
+	}
+	~move_server() {
+		for (auto& c : clients) ::close(c.fd);
+		if (listener >= 0) {
+			::close(listener);
+			::unlink(path.c_str());
+		}
+	}
+
+	/**
+	 * serve until interrupted (SIGINT or SIGTERM) or until 'limit' requests are answered
+	 */
+	int serve() {
+		if (!listen()) return -1;
+		std::cout << "serving on " << path << " with " << net->size() << " tables"
+		          << (net->is_mapped() ? " (mapped)" : "") << std::endl;
+		stopping() = 0;
+		std::signal(SIGINT, [](int) { stopping() = 1; });
+		std::signal(SIGTERM, [](int) { stopping() = 1; });
+		std::signal(SIGPIPE, SIG_IGN);
+
+		auto last = since = clock::now();
+		while (!stopping() && (!limit || answered < limit)) {
+			std::vector<pollfd> fds = { { listener, POLLIN, 0 } };
+			for (auto& c : clients) fds.push_back({ c.fd, short((c.eof ? 0 : POLLIN) | (c.out.size() ? POLLOUT : 0)), 0 });
+			int ready = ::poll(fds.data(), fds.size(), 100);
+			if (ready < 0 && errno != EINTR) break;
+			if (ready > 0) {
+				if (fds[0].revents & POLLIN) accept();
+				for (size_t i = 1; i < fds.size(); i++) {
+					if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) receive(clients[i - 1]);
+				}
+				answer();
+				for (auto& c : clients) flush(c);
+				clients.erase(std::remove_if(clients.begin(), clients.end(), [](const client& c) {
+					if (!c.closed && !(c.eof && c.out.empty())) return false;
+					::close(c.fd);
+					return true;
+				}), clients.end());
+			}
+			if (std::chrono::duration<double>(clock::now() - last).count() >= interval) {
+				report();
+				last = clock::now();
+			}
+		}
+		report();
+		return 0;
+	}
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	struct client {
+		int fd;
+		bool closed; // failed, to be dropped
+		bool eof;    // no more requests, to be dropped once answered
+		std::string in;
+		std::string out;
+	};
+	struct pending {
+		size_t client;
+		uint32_t tag;
+		board state;
+		clock::time_point received;
+	};
+
+	static volatile std::sig_atomic_t& stopping() {
+		static volatile std::sig_atomic_t flag = 0;
+		return flag;
+	}
+
+	bool listen() {
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) return false;
+		std::strcpy(addr.sun_path, path.c_str());
+		listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0) return false;
+		::unlink(path.c_str());
+		if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, 64) != 0) {
+			std::cerr << "cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		::fcntl(listener, F_SETFL, ::fcntl(listener, F_GETFL) | O_NONBLOCK);
+		return true;
+	}
+
+	void accept() {
+		for (int fd; (fd = ::accept(listener, nullptr, nullptr)) >= 0; ) {
+			::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+			clients.push_back({ fd, false, false, {}, {} });
+		}
+	}
+
+	void receive(client& c) {
+		char buf[65536];
+		while (true) {
+			ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+			if (n > 0) {
+				c.in.append(buf, n);
+				continue;
+			}
+			if (n == 0) c.eof = true;
+			else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) c.closed = true;
+			break;
+		}
+		auto now = clock::now();
+		size_t num = c.in.size() / sizeof(request);
+		for (size_t i = 0; i < num; i++) {
+			request req;
+			std::memcpy(&req, c.in.data() + i * sizeof(request), sizeof(request));
+			queue.push_back({ size_t(&c - clients.data()), req.tag, board(board::packed{ req.nibble, req.high }), now });
+		}
+		c.in.erase(0, num * sizeof(request));
+	}
+
+	void answer() {
+		std::vector<board> states;
+		std::vector<int> moves;
+		std::vector<float> values;
+		for (size_t begin = 0; begin < queue.size(); begin += batch) {
+			size_t num = std::min(batch, queue.size() - begin);
+			states.resize(num);
+			moves.resize(num);
+			values.resize(num);
+			for (size_t i = 0; i < num; i++) states[i] = queue[begin + i].state;
+			net->choose(states.data(), num, moves.data(), values.data());
+			auto now = clock::now();
+			for (size_t i = 0; i < num; i++) {
+				const pending& p = queue[begin + i];
+				response res = { p.tag, moves[i], values[i], 0 };
+				clients[p.client].out.append(reinterpret_cast<const char*>(&res), sizeof(res));
+				latency.push_back(std::chrono::duration<double, std::micro>(now - p.received).count());
+			}
+			batches++;
+			answered += num;
+		}
+		queue.clear();
+	}
+
+	void flush(client& c) {
+		while (c.out.size() && !c.closed) {
+			ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+			if (n > 0) {
+				c.out.erase(0, n);
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) c.closed = true;
+			break;
+		}
+	}
+
+	/**
+	 * e.g., "[服务] 请求=120000 (24000/s) 批次平均=37.5 延迟 p50=45us p90=80us p99=150us max=900us"
+	 */
+	void report() {
+		auto now = clock::now();
+		double elapsed = std::chrono::duration<double>(now - since).count();
+		size_t num = latency.size();
+		std::cout << "[服务] 请求=" << answered << " (" << std::fixed << std::setprecision(0) << (elapsed > 0 ? num / elapsed : 0) << "/s)";
+		std::cout << " 批次平均=" << std::setprecision(1) << (batches ? double(num) / batches : 0);
+		if (num) {
+			auto at = [&](double q) {
+				auto it = latency.begin() + std::min(num - 1, size_t(q * num));
+				std::nth_element(latency.begin(), it, latency.end());
+				return *it;
+			};
+			std::cout << std::setprecision(0) << " 延迟 p50=" << at(0.5) << "us p90=" << at(0.9) << "us p99=" << at(0.99) << "us";
+			std::cout << " max=" << *std::max_element(latency.begin(), latency.end()) << "us";
+		}
+		std::cout << std::endl;
+		latency.clear();
+		batches = 0;
+		since = now;
+	}
+
+private:
+	std::string path;
+	size_t batch;
+	double interval;
+	size_t limit;
+	std::unique_ptr<network> net;
+
+	int listener;
+	std::vector<client> clients;
+	std::vector<pending> queue;
+
+	size_t answered = 0;
+	size_t batches = 0;
+	std::vector<double> latency; // microseconds, since the last report
+	clock::time_point since = clock::now();
+};
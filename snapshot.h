@@ -0,0 +1,95 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * snapshot.h: Read-copy-update publication of immutable snapshots for concurrent readers
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+/**
+ * RCU-style publication of snapshots, e.g., of the weight tables
+ *
+ * the writer publishes an immutable copy, which replaces the current one atomically;
+ * a reader pins the current snapshot (e.g., for one game) and releases it by dropping the pointer
+ * neither side blocks the other: a pinned snapshot stays valid until its last reader releases it,
+ * which is the grace period, tracked by the reference count of the shared pointer
+ *
+ * the memory overhead is the snapshots still alive, i.e., the current one and those still pinned
+ */
+template<class type>
+class rcu {
+public:
+	typedef std::shared_ptr<const type> pointer;
+
+	/**
+	 * statistics shared with the snapshots, so that releasing a snapshot after the rcu is gone is safe
+	 */
+	struct metrics {
+		std::atomic<size_t> published;
+		std::atomic<size_t> live;      // snapshots alive, including the current one
+		std::atomic<size_t> peak;      // most snapshots alive at once
+		std::atomic<size_t> bytes;     // bytes of the snapshots alive
+		std::atomic<uint64_t> latency; // total microseconds of publishing, including the copy
+		std::atomic<uint64_t> worst;   // longest microseconds of publishing
+		metrics() : published(0), live(0), peak(0), bytes(0), latency(0), worst(0) {}
+	};
+
+public:
+	rcu() : stat(std::make_shared<metrics>()), serial(0) {}
+
+	/**
+	 * publish a copy of 'value', which takes 'bytes' of memory
+	 */
+	void publish(const type& value, size_t bytes = 0) {
+		auto begin = std::chrono::steady_clock::now();
+		std::shared_ptr<metrics> m = stat;
+		pointer next(new type(value), [m, bytes](const type* p) {
+			delete p;
+			m->live--;
+			m->bytes -= bytes;
+		});
+		size_t live = ++m->live;
+		m->bytes += bytes;
+		size_t peak = m->peak.load();
+		while (live > peak && !m->peak.compare_exchange_weak(peak, live)) {}
+		std::atomic_store(&current, next);
+		serial.fetch_add(1, std::memory_order_release);
+
+		uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+		m->published++;
+		m->latency += usec;
+		uint64_t worst = m->worst.load();
+		while (usec > worst && !m->worst.compare_exchange_weak(worst, usec)) {}
+	}
+
+	/**
+	 * pin the current snapshot, which may be empty if nothing was published
+	 */
+	pointer pin() const { return std::atomic_load(&current); }
+
+	/**
+	 * number of publications so far, for checking whether a pinned snapshot is still the latest
+	 */
+	uint64_t version() const { return serial.load(std::memory_order_acquire); }
+
+public:
+	size_t count() const { return stat->published; }
+	size_t live() const { return stat->live; }
+	size_t peak() const { return stat->peak; }
+	size_t bytes() const { return stat->bytes; }
+	double mean_latency() const { return count() ? stat->latency / 1000.0 / count() : 0; } // milliseconds
+	double max_latency() const { return stat->worst / 1000.0; } // milliseconds
+
+private:
+	std::shared_ptr<metrics> stat;
+	pointer current;
+	std::atomic<uint64_t> serial;
+};
@@ -13,9 +13,12 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <memory>
 #include "board.h"
 #include "action.h"
 #include "episode.h"
+#include "metrics.h"
+#include "paired.h"
 
 class statistics {
 public:
@@ -53,6 +56,8 @@ public:
 	 *                                  the average speed of the placer is 896715
 	 *  '93.7%': 93.7% of the games reached 8192-tiles, i.e., win rate of 8192-tile
 	 *  '22.4%': 22.4% of the games terminated with 8192-tiles as the largest tile
+	 *
+	 * the lines posted to the metrics registry (e.g., by a background evaluator) follow the first line
 	 */
 	void show(bool tstat = true, size_t blk = 0) const {
 		size_t num = std::min(data.size(), blk ?: block);
@@ -85,6 +90,8 @@ public:
 		std::cout <<      "|" << (eop * 1000.0 / edu) << ")";
 		std::cout << std::endl;
 		std::cout.copyfmt(ff);
+		for (const auto& line : metrics::global().lines())
+			std::cout << "\t" << line.second << std::endl;
 
 		if (!tstat) return;
 		for (size_t t = 0, c = 0; c < num; c += stat[t++]) {
@@ -100,6 +107,14 @@ public:
 
 	void summary() const {
 		show(true, data.size());
+		if (rule) rule->show(scores, wins);
+	}
+
+	/**
+	 * stop before 'total' games once the sequential rule is settled (see sequential)
+	 */
+	void stop_when(const std::string& args) {
+		rule.reset(new sequential(args));
 	}
 	
 	/**
@@ -132,7 +147,7 @@ public:
 	}
 
 	bool is_finished() const {
-		return count >= total;
+		return count >= total || (rule && rule->settled());
 	}
 
 	void open_episode(const std::string& flag = "") {
@@ -143,6 +158,9 @@ public:
 
 	void close_episode(const std::string& flag = "") {
 		data.back().close_episode(flag);
+		scores.add(data.back().score());
+		wins += data.back().state().is_win();
+		if (rule) rule->look(scores, wins);
 		
 		// 每100局显示简要进度
 		if (count % 100 == 0) {
@@ -186,4 +204,8 @@ private:
 	size_t limit;
 	size_t count;
 	std::deque<episode> data;
+
+	running scores; // of the games played in this run
+	size_t wins = 0;
+	std::unique_ptr<sequential> rule;
 };
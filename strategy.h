@@ -0,0 +1,31 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * strategy.h: Strategic adjustment of move values for avoiding the win condition
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include "board.h"
+
+/**
+ * the adjustment of the value of a move (reward plus afterstate value), shared by the strategic slider
+ * and the batched network (see network::choose), so that both choose the same moves
+ *
+ * the value loses 'penalty' * 10000 per unit of the danger level of the afterstate (see calculate_danger_level),
+ * and gains 'bonus' per empty cell of the afterstate; zero for both gives the plain greedy value
+ */
+struct strategy {
+	float penalty;
+	float bonus;
+
+	strategy(float penalty = 0.7f, float bonus = 1000.0f) : penalty(penalty), bonus(bonus) {}
+
+	float apply(float value, const board& after) const {
+		int empty = 0;
+		for (int i = 0; i < int(board::cells); i++) empty += (after(i) == 0);
+		return value - after.calculate_danger_level() * penalty * 10000.0f + empty * bonus;
+	}
+};
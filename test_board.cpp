@@ -0,0 +1,93 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * test_board.cpp: Tests of applying and undoing moves in place (make/unmake)
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <random>
+#include "board.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+	if (!ok) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+/**
+ * a board with random tiles up to 2^max in about 'fill' of the cells
+ */
+static board random_board(std::default_random_engine& rng, double fill = 0.6, int max = 6) {
+	board b;
+	std::bernoulli_distribution occupied(fill);
+	std::uniform_int_distribution<int> tile(1, max);
+	for (unsigned i = 0; i < board::cells; i++)
+		if (occupied(rng)) b(i) = tile(rng);
+	return b;
+}
+
+static void test_slide_round_trip() {
+	std::default_random_engine rng(1);
+	size_t legal = 0, illegal = 0;
+	for (int n = 0; n < 10000; n++) {
+		board origin = random_board(rng, n % 2 ? 0.9 : 0.5);
+		for (unsigned op = 0; op < 4; op++) {
+			board expect = origin, b = origin;
+			board::reward r = expect.slide(op);
+			board::undo u;
+			check(b.make_slide(op, u) == r, "make_slide gives the reward of slide");
+			check(b == expect, "make_slide gives the board of slide");
+			b.unmake(u);
+			check(b == origin, "unmake restores the board after make_slide");
+			(r == -1 ? illegal : legal)++;
+		}
+	}
+	check(legal && illegal, "both legal and illegal slides are covered");
+}
+
+static void test_place_round_trip() {
+	std::default_random_engine rng(2);
+	for (int n = 0; n < 1000; n++) {
+		board origin = random_board(rng);
+		for (unsigned pos = 0; pos < board::cells; pos++) {
+			for (board::cell tile = 1; tile <= 2; tile++) {
+				board b = origin;
+				board::undo u;
+				board::reward r = b.make_place(pos, tile, u);
+				if (origin(pos)) {
+					check(r == -1 && b == origin, "make_place on an occupied cell is rejected without a change");
+				} else {
+					board expect = origin;
+					expect.place(pos, tile);
+					check(r == 0 && b == expect, "make_place gives the board of place");
+				}
+				b.unmake(u);
+				check(b == origin, "unmake restores the board after make_place, even if it was rejected");
+			}
+		}
+	}
+
+	board b;
+	b(0) = 3;
+	board::undo u;
+	check(b.make_place(1, 3, u) == -1, "make_place rejects a tile other than 2 or 4");
+	b.unmake(u);
+	check(b(0) == 3 && b(1) == 0, "unmake after a rejected tile changes nothing");
+	check(b.make_place(board::cells, 1, u) == -1, "make_place rejects a position out of the board");
+	b.unmake(u);
+	check(b(0) == 3, "unmake after a rejected position changes nothing");
+}
+
+int main() {
+	test_slide_round_trip();
+	test_place_round_trip();
+	if (failures) return 1;
+	std::cout << "test_board: all passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * test_checkpoint.cpp: Tests of saving and loading the weight tables in the checkpoint and sparse formats
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <cmath>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "weight.h"
+#include "checkpoint.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+	if (!ok) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+static std::string scratch(const std::string& name) {
+	return "/tmp/test_checkpoint." + std::to_string(::getpid()) + "." + name;
+}
+
+static size_t file_size(const std::string& path) {
+	struct stat st;
+	return ::stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+/**
+ * tables of different kinds: a small dense one, a remapped one, one larger than a chunk (see checkpoint::split),
+ * and a paged one; the entries are mostly zero with random runs, as trained tables are
+ */
+static std::vector<weight> sample_net() {
+	std::default_random_engine rng(1);
+	std::uniform_real_distribution<float> value(-100, 100);
+	std::vector<weight> net;
+	net.emplace_back(65536);
+	net.emplace_back(65536);
+	net.emplace_back(checkpoint::chunk + 12345);
+	net.push_back(weight::paged(1 << 20, size_t(16) << 20));
+	for (weight& w : net) {
+		for (size_t i = 0; i < w.size(); i += 1 + rng() % 4096) {
+			for (size_t n = rng() % 64; n && i < w.size(); n--, i++) w[i] = value(rng);
+		}
+	}
+	check(net[1].remap(weight::rank(net[1].size(), [&](uint32_t i) { return -std::abs(static_cast<const weight&>(net[1])[i]); }, 4096)),
+		"the sample table is remapped");
+	checkpoint::set_cap(net, 8);
+	return net;
+}
+
+static bool same(const std::vector<weight>& a, const std::vector<weight>& b) {
+	if (a.size() != b.size() || checkpoint::cap_of(a) != checkpoint::cap_of(b)) return false;
+	for (size_t t = 0; t < a.size(); t++) {
+		if (a[t].size() != b[t].size() || a[t].remapping() != b[t].remapping()) return false;
+		for (size_t i = 0; i < a[t].size(); i++)
+			if (a[t][i] != b[t][i]) return false;
+	}
+	return true;
+}
+
+static void test_checkpoint(const std::vector<weight>& net) {
+	std::string path = scratch("ck");
+	for (unsigned threads : { 1u, 4u }) {
+		for (bool direct : { false, true }) {
+			std::string what = " (threads=" + std::to_string(threads) + (direct ? ", O_DIRECT)" : ")");
+			check(checkpoint::save(path, net, threads, direct), "save a checkpoint" + what);
+			check(checkpoint::detect(path) && !checkpoint::detect(path, checkpoint::sparse_magic), "detect a checkpoint" + what);
+			std::vector<weight> loaded;
+			check(checkpoint::load(path, loaded, threads, direct) && same(net, loaded), "save and load a checkpoint" + what);
+			std::vector<weight> buffered;
+			check(checkpoint::load(path, buffered, threads, !direct) && same(net, buffered),
+				"load a checkpoint with and without O_DIRECT alike" + what);
+		}
+	}
+
+	std::vector<weight> paged;
+	check(checkpoint::load(path, paged, 4, true, size_t(64) << 20) && same(net, paged), "load a checkpoint into paged tables");
+	bool all_paged = true;
+	for (size_t t = 0; t < paged.size(); t++) all_paged &= paged[t].is_paged() == net[t].remapping().empty();
+	check(all_paged, "loaded tables are paged unless remapped");
+
+	check(::truncate(path.c_str(), file_size(path) / 2) == 0, "truncate the checkpoint");
+	std::vector<weight> kept = net;
+	check(!checkpoint::load(path, kept, 4) && same(net, kept), "a truncated checkpoint fails to load and leaves the tables");
+	::unlink(path.c_str());
+}
+
+static void test_sparse(const std::vector<weight>& net) {
+	std::string path = scratch("sparse"), full = scratch("full");
+	check(checkpoint::export_runs(path, net), "export the runs");
+	check(checkpoint::detect(path, checkpoint::sparse_magic), "detect a sparse export");
+	std::vector<weight> loaded;
+	check(checkpoint::import_runs(path, loaded) && same(net, loaded), "export and import the runs");
+	std::vector<weight> paged;
+	check(checkpoint::import_runs(path, paged, size_t(64) << 20) && same(net, paged), "import the runs into paged tables");
+	std::vector<weight> any;
+	check(checkpoint::load_any(path, any, 4) && same(net, any), "load a sparse export by its magic");
+
+	checkpoint::save(full, net, 4);
+	check(file_size(path) < file_size(full) / 2, "a sparse export of mostly zero tables is smaller than the checkpoint");
+	::unlink(path.c_str());
+	::unlink(full.c_str());
+}
+
+static void test_stream(const std::vector<weight>& net) {
+	std::string path = scratch("stream");
+	check(checkpoint::save_stream(path, net), "save a stream");
+	check(!checkpoint::detect(path) && !checkpoint::detect(path, checkpoint::sparse_magic), "a stream is not a checkpoint");
+	std::vector<weight> loaded;
+	check(checkpoint::load_any(path, loaded, 4) && same(net, loaded), "save and load a stream");
+	::unlink(path.c_str());
+}
+
+int main() {
+	std::vector<weight> net = sample_net();
+	test_checkpoint(net);
+	test_sparse(net);
+	test_stream(net);
+	if (failures) return 1;
+	std::cout << "test_checkpoint: all passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,148 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * test_episode.cpp: Tests of writing and replaying the packed episodes
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include "board.h"
+#include "action.h"
+#include "episode.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+	if (!ok) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+/**
+ * a random game in the text of an episode, with the expected final state, score, and actions
+ * after 'dirty' moves, an illegal placement (on an occupied cell) and an illegal slide (if any) are inserted,
+ * which are not written to 'clean'
+ */
+struct game {
+	std::string clean;
+	std::string dirty;
+	board start;
+	board state;
+	board::score score = 0;
+	std::vector<action> moves;
+};
+
+static game random_game(std::default_random_engine& rng, const board& start, size_t limit, size_t dirty) {
+	static const char* tiles = "0123456789ABCDEFGHIJKLMNOPQRSTUV?";
+	game g;
+	g.start = g.state = start;
+	std::stringstream clean, dirty_text, head;
+	head << "open@100|";
+	if (start != board()) {
+		head << '{';
+		for (board::cell t : start) head << tiles[std::min(t, 32u)];
+		head << '}';
+	}
+	for (size_t n = 0; n < limit; n++) {
+		bool slide = n >= 2 && n % 2 == 0;
+		std::vector<action> legal, illegal;
+		if (slide) {
+			for (unsigned op = 0; op < 4; op++) (board(g.state).slide(op) != -1 ? legal : illegal).push_back(action::slide(op));
+		} else {
+			for (unsigned pos = 0; pos < board::cells; pos++) {
+				if (g.state(pos)) illegal.push_back(action::place(pos, 1));
+				else legal.push_back(action::place(pos, std::bernoulli_distribution(0.1)(rng) ? 2 : 1));
+			}
+		}
+		if (legal.empty()) break;
+		if (n == dirty && illegal.size()) dirty_text << illegal[rng() % illegal.size()];
+
+		action a = legal[rng() % legal.size()];
+		board::reward r = a.apply(g.state);
+		g.score += r;
+		g.moves.push_back(a);
+		std::stringstream text;
+		text << a;
+		if (r) text << '[' << r << ']';
+		if (n % 3 == 0) text << '(' << (n + 1) << ')';
+		clean << text.str();
+		dirty_text << text.str();
+	}
+	g.clean = head.str() + clean.str() + "|close@200";
+	g.dirty = head.str() + dirty_text.str() + "|close@200";
+	return g;
+}
+
+static std::string write(const episode& ep) {
+	std::stringstream out;
+	out << ep;
+	return out.str();
+}
+
+static episode read(const std::string& text) {
+	episode ep;
+	std::stringstream in(text);
+	in >> ep;
+	return ep;
+}
+
+static void check_replay(const episode& ep, const game& g, const std::string& what) {
+	check(ep.start() == g.start, what + ": the start state is replayed");
+	check(ep.state() == g.state, what + ": the final state is replayed");
+	check(ep.score() == g.score, what + ": the score is replayed");
+	std::vector<action> moves = ep.actions();
+	check(moves.size() == g.moves.size() && std::equal(moves.begin(), moves.end(), g.moves.begin(),
+		[](const action& a, const action& b) { return unsigned(a) == unsigned(b); }), what + ": the actions are replayed");
+}
+
+static void test_round_trip() {
+	std::default_random_engine rng(1);
+	for (int n = 0; n < 200; n++) {
+		game g = random_game(rng, board(), 2000, -1);
+		episode ep = read(g.clean);
+		check_replay(ep, g, "round trip");
+		std::string text = write(ep);
+		check(text == g.clean, "an episode is written as it was read, including its rewards and times");
+		check(write(read(text)) == text, "a written episode reads back the same");
+	}
+}
+
+static void test_start_state() {
+	std::default_random_engine rng(2);
+	for (int n = 0; n < 100; n++) {
+		board start;
+		for (unsigned i = 0; i < board::cells; i += 3) start(i) = 1 + rng() % 10;
+		game g = random_game(rng, start, 500, -1);
+		episode ep = read(g.clean);
+		check_replay(ep, g, "start state");
+		check(write(ep) == g.clean, "an episode from a given start state is written as it was read");
+	}
+}
+
+static void test_illegal_moves() {
+	std::default_random_engine rng(3);
+	size_t skipped = 0;
+	for (int n = 0; n < 200; n++) {
+		game g = random_game(rng, board(), 2000, n % 40);
+		if (g.dirty == g.clean) continue;
+		skipped++;
+		episode ep = read(g.dirty);
+		check_replay(ep, g, "illegal moves");
+		check(write(ep) == g.clean, "an illegal move is skipped when replaying, and is not written back");
+	}
+	check(skipped > 0, "illegal moves are covered");
+}
+
+int main() {
+	test_round_trip();
+	test_start_state();
+	test_illegal_moves();
+	if (failures) return 1;
+	std::cout << "test_episode: all passed" << std::endl;
+	return 0;
+}
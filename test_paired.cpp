@@ -0,0 +1,90 @@
+/**
+ * Framework for 2048 & 2048-Like Games (C++ 11)
+ * test_paired.cpp: Tests of the confidence intervals and the sequential stopping rule
+ *
+ * Author: Hung Guei
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <cmath>
+#include "paired.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+	if (!ok) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+static bool near(double a, double b, double tolerance = 1e-3) {
+	return std::abs(a - b) <= tolerance;
+}
+
+static void test_normal_quantile() {
+	check(near(normal_quantile(0.95), 1.95996), "normal_quantile(0.95)");
+	check(near(normal_quantile(0.99), 2.57583), "normal_quantile(0.99)");
+	check(near(normal_quantile(0.975), 2.24140), "normal_quantile(0.975)");
+	check(near(normal_quantile(0), 0), "normal_quantile(0)");
+}
+
+static void test_wilson() {
+	double z = normal_quantile(0.95);
+	std::pair<double, double> half = wilson(5, 10, z);
+	check(near(half.first, 0.23659) && near(half.second, 0.76341), "wilson(5, 10)");
+	std::pair<double, double> none = wilson(0, 10, z);
+	check(none.first == 0 && near(none.second, 0.27753), "wilson(0, 10)");
+	std::pair<double, double> all = wilson(10, 10, z);
+	check(near(all.first, 0.72247) && all.second == 1, "wilson(10, 10)");
+	std::pair<double, double> empty = wilson(0, 0, z);
+	check(empty.first == 0 && empty.second == 1, "wilson(0, 0)");
+}
+
+/**
+ * play n games whose scores alternate between mean - spread and mean + spread
+ * return the game of the decision, 0 if not settled
+ */
+static size_t play(sequential& rule, size_t n, double mean, double spread, size_t wins = 0) {
+	running scores;
+	for (size_t i = 0; i < n; i++) {
+		scores.add(i % 2 ? mean + spread : mean - spread);
+		if (rule.look(scores, i < wins ? i + 1 : wins)) return i + 1;
+	}
+	return 0;
+}
+
+static void test_stopping_rule() {
+	sequential far("score=0 every=10 min=20");
+	check(play(far, 100, 100, 10) == 20, "a mean far above the threshold settles at the first look");
+
+	sequential close("score=100 every=10 min=20");
+	check(play(close, 1000, 100, 100) == 0, "a mean at the threshold never settles");
+
+	sequential early("score=0 every=10 min=20");
+	check(play(early, 19, 100, 10) == 0, "no look before 'min' games");
+
+	sequential none("");
+	check(none.tests() == 0 && play(none, 100, 100, 10) == 0, "no threshold never settles");
+
+	// 20 games without a win: the lower Wilson bound is 0.799 at the first look with one threshold,
+	// but 0.762 with two thresholds, each of which is tested at half the error
+	sequential avoid("avoid=0.78 every=10 min=20");
+	check(avoid.tests() == 1 && play(avoid, 20, 100, 10) == 20, "the avoidance rate alone settles at the first look");
+
+	sequential both("score=0 avoid=0.78 every=10 min=20");
+	check(both.tests() == 2 && play(both, 20, 100, 10) == 0, "the error is split between two thresholds");
+	sequential later("score=0 avoid=0.78 every=10 min=20");
+	check(play(later, 30, 100, 10) == 30, "both thresholds settle at the second look");
+}
+
+int main() {
+	test_normal_quantile();
+	test_wilson();
+	test_stopping_rule();
+	if (failures) return 1;
+	std::cout << "test_paired: all passed" << std::endl;
+	return 0;
+}
@@ -11,39 +11,563 @@
 #include <iostream>
 #include <vector>
 #include <utility>
+#include <cstdint>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
+/**
+ * zero-initialized array whose memory becomes resident only when touched
+ *
+ * large arrays are backed by anonymous mmap, whose pages are mapped to the shared zero page until written,
+ * so allocating a table costs nearly nothing and the untouched entries never take physical memory
+ * small arrays (or platforms without mmap) fall back to calloc
+ *
+ * unlike std::vector, resize() does not keep the contents, and copying touches every page of the copy
+ */
+template<class type>
+class lazy_array {
+public:
+	lazy_array(size_t len = 0) : ptr(nullptr), len(0), mapped(false) { allocate(len); }
+	lazy_array(const lazy_array& a) : ptr(nullptr), len(0), mapped(false) {
+		allocate(a.len);
+		if (len) std::memcpy(ptr, a.ptr, sizeof(type) * len);
+	}
+	lazy_array(lazy_array&& a) noexcept : ptr(a.ptr), len(a.len), mapped(a.mapped) { a.ptr = nullptr; a.len = 0; }
+	~lazy_array() { release(); }
+
+	lazy_array& operator =(const lazy_array& a) {
+		if (this != &a) {
+			lazy_array copy(a);
+			swap(copy);
+		}
+		return *this;
+	}
+	lazy_array& operator =(lazy_array&& a) noexcept {
+		swap(a);
+		return *this;
+	}
+
+	type& operator[] (size_t i) { return ptr[i]; }
+	const type& operator[] (size_t i) const { return ptr[i]; }
+	size_t size() const { return len; }
+	type* data() { return ptr; }
+	const type* data() const { return ptr; }
+
+	/**
+	 * reallocate as 'n' zeros
+	 */
+	void resize(size_t n) {
+		release();
+		allocate(n);
+	}
+	void clear() { resize(0); }
+	void swap(lazy_array& a) noexcept {
+		std::swap(ptr, a.ptr);
+		std::swap(len, a.len);
+		std::swap(mapped, a.mapped);
+	}
+
+	/**
+	 * the bytes touched so far, i.e., the pages resident by mincore() where available
+	 * (a page only read is mapped to the zero page but is counted as well)
+	 */
+	size_t resident() const {
+#if defined(__linux__)
+		if (mapped) {
+			size_t page = sysconf(_SC_PAGESIZE), pages = (sizeof(type) * len + page - 1) / page;
+			std::vector<unsigned char> vec(pages);
+			if (mincore(ptr, sizeof(type) * len, vec.data()) == 0) {
+				size_t num = 0;
+				for (unsigned char v : vec) num += (v & 1);
+				return std::min(num * page, sizeof(type) * len);
+			}
+		}
+#endif
+		return sizeof(type) * len;
+	}
+
+private:
+	static constexpr size_t threshold = size_t(1) << 16; // bytes, below which calloc is used
+
+	void allocate(size_t n) {
+		if (n == 0) return;
+#if defined(__unix__) || defined(__APPLE__)
+		if (sizeof(type) * n >= threshold) {
+			void* p = mmap(nullptr, sizeof(type) * n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED) throw std::bad_alloc();
+			ptr = static_cast<type*>(p);
+			len = n;
+			mapped = true;
+			return;
+		}
+#endif
+		ptr = static_cast<type*>(std::calloc(n, sizeof(type)));
+		if (!ptr) throw std::bad_alloc();
+		len = n;
+		mapped = false;
+	}
+	void release() {
+		if (!ptr) return;
+#if defined(__unix__) || defined(__APPLE__)
+		if (mapped) munmap(ptr, sizeof(type) * len);
+		else std::free(ptr);
+#else
+		std::free(ptr);
+#endif
+		ptr = nullptr;
+		len = 0;
+	}
+
+private:
+	type* ptr;
+	size_t len;
+	bool mapped;
+};
+
+/**
+ * sparse index remapping, which moves a short list of hot indices to the front of a table
+ *
+ * hot index hot[s] is moved to slot s by swapping it with the index stored there, in the order of the list,
+ * so only the moved indices (at most twice the list) differ from the identity; they are kept in a small
+ * open-addressing hash, so that a lookup stays in cache rather than adding a miss to every access
+ * the list itself is what is saved, the moves are rebuilt from it
+ */
+class hot_map {
+public:
+	hot_map() : mask(0) {}
+	hot_map(const uint32_t* list, size_t len) : hot(list, list + len), mask(0) {
+		if (hot.empty()) return;
+		size_t size = 1;
+		while (size < hot.size() * 4) size <<= 1;
+		cells.assign(size, { uint32_t(none), 0 }); // a copy, so that 'none' needs no definition out of the class
+		mask = size - 1;
+		std::unordered_map<uint32_t, uint32_t> at; // the index at each slot moved so far
+		for (uint32_t s = 0; s < hot.size(); s++) {
+			uint32_t i = hot[s], from = slot(i);
+			if (from == s) continue;
+			auto it = at.find(s);
+			uint32_t j = it != at.end() ? it->second : s; // the index at slot s, which moves to where i was
+			insert(i, s), at[s] = i;
+			insert(j, from), at[from] = j;
+		}
+	}
+
+	bool empty() const { return hot.empty(); }
+	const std::vector<uint32_t>& list() const { return hot; }
+
+	/**
+	 * the slot of an index
+	 */
+	size_t slot(size_t i) const {
+		if (!mask) return i;
+		for (size_t h = hash(i) & mask; ; h = (h + 1) & mask) {
+			if (cells[h].first == i) return cells[h].second;
+			if (cells[h].first == none) return i;
+		}
+	}
+
+	/**
+	 * the indices whose slot differs from the identity
+	 */
+	std::vector<uint32_t> moved() const {
+		std::vector<uint32_t> res;
+		for (const auto& c : cells)
+			if (c.first != none && c.first != c.second) res.push_back(c.first);
+		return res;
+	}
+
+private:
+	static constexpr uint32_t none = uint32_t(-1);
+	static size_t hash(size_t i) { return (i * 0x9e3779b97f4a7c15ull) >> 32; }
+
+	void insert(uint32_t i, uint32_t s) {
+		for (size_t h = hash(i) & mask; ; h = (h + 1) & mask) {
+			if (cells[h].first == i || cells[h].first == none) {
+				cells[h] = { i, s };
+				return;
+			}
+		}
+	}
+
+private:
+	std::vector<uint32_t> hot;
+	std::vector<std::pair<uint32_t, uint32_t>> cells; // (index, slot), 'none' for an empty cell
+	size_t mask;
+};
+
+/**
+ * weight table, optionally with an index remapping
+ *
+ * the remapping (see hot_map) moves the frequently visited indices (e.g., feature indices) to the first slots,
+ * so that they are kept contiguous; all accesses by index go through the remapping transparently,
+ * while data() exposes the slots in storage order
+ *
+ * a table can also be paged (see paged()) for large tuples whose entries are mostly never visited:
+ * pages of 2^page_bits entries are allocated on the first write, while reading an absent page gives zero
+ * at most 'budget' pages are kept; beyond that, a page not written since the last sweep is evicted (clock),
+ * i.e., its entries fall back to zero; a paged table has neither a remapping nor data()
+ */
 class weight {
 public:
 	typedef float type;
+	static constexpr unsigned page_bits = 12;
+	static constexpr size_t page_size = size_t(1) << page_bits;
 
 public:
-	weight() {}
-	weight(size_t len) : value(len) {}
-	weight(weight&& f) : value(std::move(f.value)) {}
+	weight() : radix(0), span(0), budget(0), hand(0), stat() {}
+	weight(size_t len) : value(len), radix(0), span(0), budget(0), hand(0), stat() {}
+	weight(weight&& f) = default;
 	weight(const weight& f) = default;
 
+	/**
+	 * a paged table of 'len' entries, keeping at most 'bytes' of pages
+	 */
+	static weight paged(size_t len, size_t bytes) {
+		weight w;
+		w.page(len, bytes);
+		return w;
+	}
+
 	weight& operator =(const weight& f) = default;
-	type& operator[] (size_t i) { return value[i]; }
-	const type& operator[] (size_t i) const { return value[i]; }
-	size_t size() const { return value.size(); }
+	weight& operator =(weight&& f) = default;
+
+	/**
+	 * an entry of a non-const table; reading goes through the const access, so that reading an absent page
+	 * of a paged table gives zero rather than allocating the page, which only writing does
+	 */
+	class entry {
+	public:
+		entry(weight& w, size_t i) : w(w), i(i) {}
+		operator type() const { return static_cast<const weight&>(w)[i]; }
+		entry& operator =(type v) { w.write(i) = v; return *this; }
+		entry& operator =(const entry& e) { return *this = type(e); }
+		entry& operator +=(type v) { w.write(i) += v; return *this; }
+		entry& operator -=(type v) { w.write(i) -= v; return *this; }
+	private:
+		weight& w;
+		size_t i;
+	};
+
+	entry operator[] (size_t i) { return entry(*this, i); }
+	const type& operator[] (size_t i) const { return budget ? peek(i) : value[slot(i)]; }
+	size_t size() const { return budget ? span : value.size(); }
+
+	type* data() { return value.data(); }
+	const type* data() const { return value.data(); }
+	size_t slot(size_t i) const { return hot.slot(i); }
+
+	/**
+	 * the entry at a slot, i.e., in storage order
+	 */
+	type& stored(size_t s) { return budget ? write(s) : value[s]; }
+
+	/**
+	 * reset to 'len' zeros, keeping whether the table is paged (and its budget)
+	 */
+	void reset(size_t len) {
+		if (budget) {
+			page(len, budget_bytes());
+		} else {
+			value.resize(len);
+			hot = hot_map();
+		}
+	}
+
+	/**
+	 * copy 'num' entries from slot 'begin' in storage order, for block I/O
+	 * reading into a paged table only allocates the pages with any non-zero entry
+	 */
+	void export_range(size_t begin, size_t num, type* out) const {
+		if (!budget) {
+			std::copy(value.data() + begin, value.data() + begin + num, out);
+			return;
+		}
+		for (size_t i = begin, end = begin + num; i < end; ) {
+			size_t p = i >> page_bits, len = std::min(end, (p + 1) << page_bits) - i;
+			if (pages[p].empty()) std::fill(out, out + len, type(0));
+			else std::copy(pages[p].data() + (i & (page_size - 1)), pages[p].data() + (i & (page_size - 1)) + len, out);
+			i += len;
+			out += len;
+		}
+	}
+	void import_range(size_t begin, size_t num, const type* in) {
+		if (!budget) {
+			std::copy(in, in + num, value.data() + begin);
+			return;
+		}
+		for (size_t i = begin, end = begin + num; i < end; ) {
+			size_t p = i >> page_bits, len = std::min(end, (p + 1) << page_bits) - i;
+			if (!pages[p].empty() || std::any_of(in, in + len, [](type v) { return v != 0; }))
+				std::copy(in, in + len, touch(p) + (i & (page_size - 1)));
+			i += len;
+			in += len;
+		}
+	}
 
 public:
+	/**
+	 * rearrange the storage by a new list of hot indices (see hot_map), i.e., index next[s] is moved to slot s
+	 * an empty list restores the identity order
+	 * if 'rearrange' is false, the storage is assumed to be already in the new order (e.g., when loading)
+	 * a paged table becomes dense when given a non-empty list
+	 * return false (and keep the table as is) if the list has an index out of the table
+	 */
+	bool remap(const std::vector<uint32_t>& next, bool rearrange = true) {
+		if (next.size() > size() || std::any_of(next.begin(), next.end(), [&](uint32_t i) { return i >= size(); })) return false;
+		if (budget) {
+			if (next.empty()) return true;
+			lazy_array<type> dense(span);
+			export_range(0, span, dense.data());
+			unsigned c = radix;
+			*this = weight();
+			value.swap(dense);
+			radix = c;
+		}
+		hot_map map(next.data(), next.size());
+		if (rearrange) { // only the indices moved by either remapping change their slots
+			std::vector<uint32_t> moved = hot.moved(), more = map.moved();
+			moved.insert(moved.end(), more.begin(), more.end());
+			std::vector<type> held(moved.size());
+			for (size_t k = 0; k < moved.size(); k++) held[k] = value[slot(moved[k])];
+			for (size_t k = 0; k < moved.size(); k++) value[map.slot(moved[k])] = held[k];
+		}
+		hot = std::move(map);
+		return true;
+	}
+	const std::vector<uint32_t>& remapping() const { return hot.list(); }
+	const hot_map& mapping() const { return hot; }
+
+	/**
+	 * the tile cap of the indices (see ntuple), saved along with the table; 0 if not recorded
+	 */
+	unsigned cap() const { return radix; }
+	void cap(unsigned c) { radix = c; }
+
+	/**
+	 * the list of hot indices by a key, e.g., a visit count or a tile rank, at most 'limit' of them
+	 * the index with the smallest key is placed at slot 0, ties are kept in index order
+	 */
+	template<class key>
+	static std::vector<uint32_t> rank(size_t len, key k, size_t limit) {
+		std::vector<uint32_t> index(len);
+		for (size_t i = 0; i < len; i++) index[i] = i;
+		limit = std::min(limit, len);
+		std::partial_sort(index.begin(), index.begin() + limit, index.end(), [&](uint32_t a, uint32_t b) {
+			return k(a) < k(b) || (!(k(b) < k(a)) && a < b);
+		});
+		index.resize(limit);
+		return index;
+	}
+
+public:
+	/**
+	 * statistics of a paged table
+	 */
+	struct paging {
+		size_t resident; // pages currently allocated
+		size_t peak;     // most pages allocated at once
+		size_t faults;   // pages allocated on write
+		size_t evicted;  // pages evicted to stay within the budget
+	};
+
+	/**
+	 * turn the table into a paged table of 'len' entries with at most 'bytes' of pages
+	 * the current entries are discarded
+	 */
+	void page(size_t len, size_t bytes) {
+		value.clear();
+		hot = hot_map();
+		span = len;
+		budget = std::max<size_t>(bytes / (page_size * sizeof(type)), 1);
+		pages.assign((len + page_size - 1) >> page_bits, std::vector<type>());
+		referenced.assign(pages.size(), 0);
+		hand = 0;
+		stat = paging();
+	}
+	bool is_paged() const { return budget != 0; }
+	size_t budget_bytes() const { return budget * page_size * sizeof(type); }
+	const paging& paging_stat() const { return stat; }
+	size_t resident_bytes() const { return budget ? stat.resident * page_size * sizeof(type) : value.resident(); }
+
+	/**
+	 * the bytes taken by a copy of the table, which is resident as a whole since copying touches every page
+	 */
+	size_t copy_bytes() const {
+		return (budget ? stat.resident * page_size : value.size()) * sizeof(type) + sizeof(uint32_t) * hot.list().size();
+	}
+
+private:
+	type& write(size_t i) { return budget ? touch(i >> page_bits)[i & (page_size - 1)] : value[slot(i)]; }
+
+	const type& peek(size_t i) const {
+		static const type zero = 0;
+		const std::vector<type>& p = pages[i >> page_bits];
+		return p.empty() ? zero : p[i & (page_size - 1)];
+	}
+
+	type* touch(size_t p) {
+		if (pages[p].empty()) {
+			if (stat.resident >= budget) evict();
+			pages[p].assign(page_size, 0);
+			stat.resident++;
+			stat.faults++;
+			stat.peak = std::max(stat.peak, stat.resident);
+		}
+		referenced[p] = 1;
+		return pages[p].data();
+	}
+
+	/**
+	 * second-chance sweep over the pages: a referenced page is spared once, the first unreferenced one is freed
+	 */
+	void evict() {
+		for (;;) {
+			hand = (hand + 1) % pages.size();
+			if (pages[hand].empty()) continue;
+			if (referenced[hand]) {
+				referenced[hand] = 0;
+				continue;
+			}
+			std::vector<type>().swap(pages[hand]);
+			stat.resident--;
+			stat.evicted++;
+			return;
+		}
+	}
+
+public:
+	/**
+	 * paged tables are written in the same format as the dense ones, with the absent pages as zeros
+	 * when reading into a paged table, only the pages with any non-zero entry are allocated
+	 */
 	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
 		auto& value = w.value;
-		uint64_t size = value.size();
+		uint64_t size = w.size();
 		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
-		out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * size);
+		if (!w.budget) {
+			out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * size);
+			return out;
+		}
+		std::vector<type> buf(page_size);
+		for (size_t i = 0; i < size; i += page_size) {
+			size_t len = std::min(size_t(page_size), size - i);
+			w.export_range(i, len, buf.data());
+			out.write(reinterpret_cast<const char*>(buf.data()), sizeof(type) * len);
+		}
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, weight& w) {
-		auto& value = w.value;
 		uint64_t size = 0;
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
-		value.resize(size);
-		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * size);
+		w.reset(size);
+		if (!w.budget) {
+			in.read(reinterpret_cast<char*>(w.value.data()), sizeof(type) * size);
+			return in;
+		}
+		std::vector<type> buf(page_size);
+		for (size_t i = 0; i < size; i += page_size) {
+			size_t len = std::min(size_t(page_size), size - i);
+			in.read(reinterpret_cast<char*>(buf.data()), sizeof(type) * len);
+			w.import_range(i, len, buf.data());
+		}
 		return in;
 	}
 
 protected:
-	std::vector<type> value;
+	lazy_array<type> value;
+	hot_map hot;
+	unsigned radix;
+
+	size_t span; // number of entries of a paged table
+	size_t budget; // most pages of a paged table, 0 for a dense table
+	std::vector<std::vector<type>> pages;
+	std::vector<uint8_t> referenced;
+	size_t hand;
+	paging stat;
+};
+
+/**
+ * batched updates for a set of weight tables
+ *
+ * (table, index, delta) updates are accumulated instead of being applied one by one;
+ * apply() radix-sorts them by storage address (after remapping), merges the duplicates, and applies them in one
+ * sequential sweep, so that the scattered writes become a mostly sequential pass
+ */
+class weight_batch {
+public:
+	weight_batch() : merged(0), swept(0) {}
+
+	void add(size_t table, size_t index, weight::type delta) {
+		updates.push_back({ table, index, delta });
+	}
+
+	/**
+	 * apply and clear all accumulated updates
+	 */
+	void apply(std::vector<weight>& net) {
+		if (updates.empty()) return;
+		std::vector<uint64_t> base(net.size() + 1, 0);
+		for (size_t i = 0; i < net.size(); i++) base[i + 1] = base[i] + net[i].size();
+
+		list.clear();
+		list.reserve(updates.size());
+		for (const update& u : updates) {
+			if (u.table < net.size() && u.index < net[u.table].size())
+				list.push_back({ base[u.table] + net[u.table].slot(u.index), u.delta });
+		}
+		updates.clear();
+		sort(base.back());
+
+		for (size_t i = 0, t = 0; i < list.size(); ) {
+			uint64_t key = list[i].key;
+			weight::type delta = 0;
+			for (; i < list.size() && list[i].key == key; i++) delta += list[i].delta;
+			while (key >= base[t + 1]) t++;
+			net[t].stored(key - base[t]) += delta;
+			swept++;
+		}
+		merged += list.size();
+	}
+
+	size_t size() const { return updates.size(); }
+	size_t entries() const { return merged; } // number of updates applied so far
+	size_t writes() const { return swept; } // number of distinct weights written so far
+
+private:
+	/**
+	 * LSD radix sort on keys less than 'limit', 16 bits per pass
+	 */
+	void sort(uint64_t limit) {
+		temp.resize(list.size());
+		for (unsigned shift = 0; shift < 64 && (limit - 1) >> shift; shift += 16) {
+			std::vector<size_t> count((1 << 16) + 1, 0);
+			for (const entry& e : list) count[((e.key >> shift) & 0xffff) + 1]++;
+			for (size_t i = 1; i < count.size(); i++) count[i] += count[i - 1];
+			for (const entry& e : list) temp[count[(e.key >> shift) & 0xffff]++] = e;
+			std::swap(list, temp);
+		}
+	}
+
+private:
+	struct update {
+		size_t table;
+		size_t index;
+		weight::type delta;
+	};
+	struct entry {
+		uint64_t key;
+		weight::type delta;
+	};
+	std::vector<update> updates;
+	std::vector<entry> list;
+	std::vector<entry> temp;
+	size_t merged;
+	size_t swept;
 };